@@ -0,0 +1,308 @@
+#ifdef __psp__
+    #include <pspkernel.h>
+    #include <psprtc.h>
+    #define SDL_MAIN_HANDLED
+#endif
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include "../simple_text.h"
+#include <new>
+#ifndef __psp__
+    #include <unistd.h>
+#endif
+
+#ifdef __psp__
+    PSP_MODULE_INFO("SDL2 Text Bench", 0, 1, 1);
+    PSP_MAIN_THREAD_ATTR(THREAD_ATTR_USER | THREAD_ATTR_VFPU);
+#endif
+
+/*
+Fixed workloads over the text pipeline, reported as ns per glyph and heap
+allocations per frame. Run from the folder that contains gfx/, or pass it
+as the first argument on desktop builds. Results are also written to
+bench_results.txt.
+*/
+
+static uint64_t allocation_count = 0;
+
+void *operator new(size_t size)
+{
+    allocation_count++;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr)
+        abort();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    allocation_count++;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr)
+        abort();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+uint64_t now_ns()
+{
+#ifdef __psp__
+    return (uint64_t)sceKernelGetSystemTimeWide() * 1000;
+#else
+    static const uint64_t frequency = SDL_GetPerformanceFrequency();
+    const uint64_t counter = SDL_GetPerformanceCounter();
+    return (counter / frequency) * 1000000000ull + (counter % frequency) * 1000000000ull / frequency;
+#endif
+}
+
+const char atlas_characters[] = "!\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{¦}~⌂ÇçáéíóúãõüâêôñÑÁÉÍÓÚÃÕÜÂÊÔªº¿";
+
+const char sample_text[] = "Multiline test ÃÕêíó[] \"()\" 1234567890@#%&*~ The quick brown fox jumps over the lazy dog. ";
+
+const int text_lengths[] = {16, 64, 256, 1024};
+
+/// Amount of glyphs each workload processes per text length, split in frames.
+const int glyph_budget = 16384;
+
+FILE *results = nullptr;
+
+struct Measure
+{
+    uint64_t start_ns;
+    uint64_t start_allocations;
+
+    void begin()
+    {
+        start_allocations = allocation_count;
+        start_ns = now_ns();
+    }
+
+    void end(const char *workload, const int length, const int frames, const uint64_t glyphs)
+    {
+        const uint64_t elapsed = now_ns() - start_ns;
+        const uint64_t allocations = allocation_count - start_allocations;
+        char line[160];
+        snprintf(line, sizeof(line), "%-18s %5d chars  %10.1f ns/glyph  %8.2f allocs/frame\n",
+                 workload,
+                 length,
+                 glyphs ? (double)elapsed / glyphs : 0.0,
+                 frames ? (double)allocations / frames : 0.0);
+        printf("%s", line);
+        if (results)
+            fputs(line, results);
+    }
+};
+
+/**
+ * Build a text of exactly length characters by repeating the sample text.
+ */
+std::string make_text(const int length)
+{
+    std::string text;
+    const char *it = sample_text;
+    const char *end = sample_text + strlen(sample_text);
+    for (int i = 0; i < length; i++)
+    {
+        if (it == end)
+            it = sample_text;
+        const char *start = it;
+        decode_next(it, end);
+        text.append(start, it - start);
+    }
+    return text;
+}
+
+void run(const std::string &text, const FontAtlas &atlas, SDL_Renderer *renderer)
+{
+    const int length = (int)utf8_length(text);
+    const int frames = glyph_budget / length > 8 ? glyph_budget / length : 8;
+    const uint64_t glyphs = (uint64_t)frames * length;
+    const SDL_Rect rect = {16, 16, 480 - 32, 272 - 32};
+    Measure m;
+
+    std::vector<uint32_t> decoded(length);
+    m.begin();
+    for (int f = 0; f < frames; f++)
+    {
+        std::vector<uint32_t> v = get_utf8_char_vector(text.c_str());
+        decoded[0] = v[0];
+    }
+    m.end("decode/vector", length, frames, glyphs);
+
+    m.begin();
+    for (int f = 0; f < frames; f++)
+        decode_utf8(text, decoded.data(), decoded.size());
+    m.end("decode/buffer", length, frames, glyphs);
+
+    volatile int sink = 0;
+    m.begin();
+    for (int f = 0; f < frames; f++)
+    {
+        for (int i = 0; i < length; i++)
+            sink += get_char_index(decoded[i], atlas.characters);
+    }
+    m.end("lookup/scan", length, frames, glyphs);
+
+    m.begin();
+    for (int f = 0; f < frames; f++)
+    {
+        for (int i = 0; i < length; i++)
+            sink += atlas.glyph_index(decoded[i]);
+    }
+    m.end("lookup/table", length, frames, glyphs);
+
+    m.begin();
+    for (int f = 0; f < frames; f++)
+    {
+        std::vector<std::string> lines = get_all_lines(text, atlas, 16, 57, rect.w);
+        sink += (int)lines.size();
+    }
+    m.end("wrap/lines", length, frames, glyphs);
+
+    std::vector<LineSpan> spans;
+    m.begin();
+    for (int f = 0; f < frames; f++)
+        sink += (int)wrap_text(text, &atlas, 16, 57, rect.w, spans);
+    m.end("wrap/spans", length, frames, glyphs);
+
+    std::vector<LineSpan> draw_spans;
+    wrap_text(text, &atlas, 16, 57, rect.w, draw_spans);
+    std::vector<std::string> draw_lines;
+    for (const auto &span : draw_spans)
+        draw_lines.push_back(text.substr(span.offset, span.length));
+    const int draw_frames = frames / 8 > 4 ? frames / 8 : 4;
+    const uint64_t draw_glyphs = (uint64_t)draw_frames * length;
+
+    m.begin();
+    for (int f = 0; f < draw_frames; f++)
+    {
+        SDL_RenderClear(renderer);
+        draw_text_multiline(text, atlas, renderer, rect, 16, 57, 70);
+        SDL_RenderPresent(renderer);
+    }
+    m.end("draw/immediate", length, draw_frames, draw_glyphs);
+
+    TextBatch batch;
+    m.begin();
+    for (int f = 0; f < draw_frames; f++)
+    {
+        SDL_RenderClear(renderer);
+        int y = rect.y;
+        for (const auto &line : draw_lines)
+        {
+            draw_text_batched(line, atlas, batch, rect.x, y, 16, 57);
+            y += 16 * 70 / 100;
+        }
+        batch.flush(renderer);
+        SDL_RenderPresent(renderer);
+    }
+    m.end("draw/batched", length, draw_frames, draw_glyphs);
+
+    TextLayout quads_layout;
+    build_text_layout(quads_layout, text, atlas, 16, 57, 70, rect.w);
+    m.begin();
+    for (int f = 0; f < draw_frames; f++)
+    {
+        SDL_RenderClear(renderer);
+        draw_text_layout_batched(quads_layout, atlas, batch, rect.x, rect.y);
+        batch.flush(renderer);
+        SDL_RenderPresent(renderer);
+    }
+    m.end("draw/layout_quads", length, draw_frames, draw_glyphs);
+
+    CombinedTexture target;
+    m.begin();
+    for (int f = 0; f < draw_frames; f++)
+    {
+        target.reset();
+        SDL_RenderClear(renderer);
+        draw_text_multiline(text, atlas, renderer, rect, 16, 57, 70, &target);
+        SDL_RenderPresent(renderer);
+    }
+    m.end("draw/target", length, draw_frames, draw_glyphs);
+
+    // The typewriter reveals one glyph per frame, so each frame is one glyph.
+    std::string typed = text;
+    CombinedTexture type_target;
+    TypeStats stats(0, rect.x, 0.0f, 1.0f);
+    int type_frames = 0;
+    m.begin();
+    while (stats.type_counter < (int)stats.layout.glyphs.size() || type_frames == 0)
+    {
+        stats.timer = 1.0f;
+        SDL_RenderClear(renderer);
+        draw_typewriter(typed, atlas, renderer, rect, &type_target, stats, 16, nullptr, 57, 70);
+        SDL_RenderPresent(renderer);
+        type_frames++;
+    }
+    m.end("typewriter", length, type_frames, (uint64_t)type_frames);
+}
+
+/**
+ * A score counter changing every frame, formatted with snprintf or kept in a DynamicText.
+ */
+void run_counter(const FontAtlas &atlas, SDL_Renderer *renderer)
+{
+    const int frames = glyph_budget / 8;
+    const uint64_t glyphs = (uint64_t)frames * 8;
+    Measure m;
+
+    m.begin();
+    for (int f = 0; f < frames; f++)
+    {
+        char text[16];
+        snprintf(text, sizeof(text), "%08d", f * 7);
+        SDL_RenderClear(renderer);
+        draw_text(text, atlas, renderer, 16, 16, 16, 57);
+        SDL_RenderPresent(renderer);
+    }
+    m.end("counter/string", 8, frames, glyphs);
+
+    DynamicText counter(atlas, 8, 16, 16, 16, 57);
+    m.begin();
+    for (int f = 0; f < frames; f++)
+    {
+        counter.set_int(f * 7, 8);
+        SDL_RenderClear(renderer);
+        counter.draw(renderer);
+        SDL_RenderPresent(renderer);
+    }
+    m.end("counter/dynamic", 8, frames, glyphs);
+}
+
+int main(int argc, char *argv[])
+{
+#ifndef __psp__
+    if (argc > 1)
+        chdir(argv[1]);
+#endif
+    (void)argc;
+    (void)argv;
+
+    SDL_Window *window = SDL_CreateWindow("Simple Text Bench", 0, 0, 480, 272, 0);
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_TARGETTEXTURE);
+    FontAtlas atlas("gfx/atlas.png", renderer, atlas_characters);
+    if (atlas.atlas_texture == nullptr)
+    {
+        printf("Could not load gfx/atlas.png: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    results = fopen("bench_results.txt", "w");
+    for (int length : text_lengths)
+    {
+        run(make_text(length), atlas, renderer);
+    }
+    run_counter(atlas, renderer);
+    if (results)
+        fclose(results);
+
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}
@@ -24,21 +24,364 @@ SOFTWARE.
 
 #ifndef PGGK_SIMPLE_TEXT_H
 #define PGGK_SIMPLE_TEXT_H
+#include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <atomic>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <sstream>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 
+#if !defined(SIMPLE_TEXT_NO_SIMD) && (defined(__SSE__) || defined(_M_X64))
+#include <xmmintrin.h>
+#define SIMPLE_TEXT_SSE
+#elif !defined(SIMPLE_TEXT_NO_SIMD) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMPLE_TEXT_NEON
+#elif !defined(SIMPLE_TEXT_NO_SIMD) && defined(__psp__)
+#define SIMPLE_TEXT_VFPU
+#endif
+
+#ifdef __psp__
+#include <pspkernel.h>
+#endif
+
+#if defined(__psp__) && defined(SIMPLE_TEXT_GU)
+#include <malloc.h>
+#include <pspgu.h>
+#include <pspkernel.h>
+#endif
+
+#ifdef SIMPLE_TEXT_SDF_GL
+#include <SDL2/SDL_opengl.h>
+#endif
+
+#if defined(SIMPLE_TEXT_STATS) || defined(SIMPLE_TEXT_COUNT_ALLOCS)
+/// Set on threads that must not touch the frame counters, like the TextWorker thread.
+/// Only the render thread counts, the counters are plain globals it reads and resets.
+thread_local bool text_stats_disabled = false;
+#endif
+
+#ifdef SIMPLE_TEXT_STATS
+/**
+ * @brief Counters of the text hot paths during one frame.
+ *
+ * Only compiled with SIMPLE_TEXT_STATS defined. The counters are reset by
+ * text_frame_begin(), and text_stats_snapshot() returns the previous frame.
+ * Times are inclusive, so draw time also covers the decode and wrap it does.
+ */
+struct TextStats
+{
+    /// SDL_RenderCopy calls.
+    uint32_t render_copies;
+
+    /// SDL_RenderGeometry and sceGuDrawArray calls.
+    uint32_t geometry_draws;
+
+    /// SDL_SetRenderTarget calls.
+    uint32_t target_switches;
+
+    /// Textures created, glyph pages, render targets and cached texts.
+    uint32_t texture_creates;
+
+    /// Textures destroyed.
+    uint32_t texture_destroys;
+
+    /// Glyphs sent to be drawn, as copies or quads.
+    uint32_t glyphs_drawn;
+
+    /// Calls to FontAtlas::glyph_index.
+    uint32_t glyph_lookups;
+
+    /// Calls to build_text_layout.
+    uint32_t layout_builds;
+
+    /// Bytes taken from the frame arena, and from the heap when SIMPLE_TEXT_COUNT_ALLOCS is defined.
+    size_t bytes_allocated;
+
+    /// Nanoseconds spent decoding, wrapping and drawing text.
+    uint64_t decode_ns;
+    uint64_t wrap_ns;
+    uint64_t draw_ns;
+};
+
+/// Counters of the current frame.
+TextStats text_stats_current = {};
+
+/// Counters of the last finished frame.
+TextStats text_stats_last = {};
+
+/// Timed sections currently open, to not count nested calls twice.
+uint32_t text_stats_timing = 0;
+
+/**
+ * @brief Add the time until the end of the scope to a TextStats field.
+ */
+struct TextStatsTimer
+{
+    uint64_t *field;
+    uint32_t bit;
+    uint64_t start;
+
+    TextStatsTimer(uint64_t &_field, const uint32_t _bit)
+    {
+        field = (text_stats_disabled || (text_stats_timing & _bit)) ? nullptr : &_field;
+        bit = _bit;
+        if (field)
+        {
+            text_stats_timing |= bit;
+            start = SDL_GetPerformanceCounter();
+        }
+    }
+
+    ~TextStatsTimer()
+    {
+        if (field == nullptr)
+            return;
+        static const uint64_t frequency = SDL_GetPerformanceFrequency();
+        *field += (SDL_GetPerformanceCounter() - start) * 1000000000ull / frequency;
+        text_stats_timing &= ~bit;
+    }
+};
+
+#define SIMPLE_TEXT_COUNT(field, amount) (text_stats_disabled ? (void)0 : (void)(text_stats_current.field += (amount)))
+#define SIMPLE_TEXT_TIME_DECODE TextStatsTimer text_stats_timer(text_stats_current.decode_ns, 1)
+#define SIMPLE_TEXT_TIME_WRAP TextStatsTimer text_stats_timer(text_stats_current.wrap_ns, 2)
+#define SIMPLE_TEXT_TIME_DRAW TextStatsTimer text_stats_timer(text_stats_current.draw_ns, 4)
+#else
+#define SIMPLE_TEXT_COUNT(field, amount) ((void)0)
+#define SIMPLE_TEXT_TIME_DECODE ((void)0)
+#define SIMPLE_TEXT_TIME_WRAP ((void)0)
+#define SIMPLE_TEXT_TIME_DRAW ((void)0)
+#endif
+
+/**
+ * @brief Reusable render target textures, shared by CombinedTexture objects.
+ *
+ * Released textures are kept and handed out again to requests of the same
+ * format and rounded size, so opening and closing text boxes doesn't create
+ * and destroy textures in the middle of a scene. Sizes are rounded up to powers
+ * of two, the size the PSP allocates in VRAM anyway.
+ * Free textures are evicted, least recently used first, to stay under the budget.
+ * Textures in use are kept even if that goes over it.
+ * The pool must outlive the textures acquired from it.
+ */
+struct TexturePool
+{
+    struct Entry
+    {
+        SDL_Texture *texture = nullptr;
+        Uint32 format = 0;
+        int w = 0;
+        int h = 0;
+        size_t bytes = 0;
+        bool in_use = false;
+        uint32_t last_used = 0;
+    };
+
+    /// Max amount of VRAM used by the pooled textures, in bytes, 0 means no limit.
+    size_t budget;
+
+    /// Amount of VRAM used by every pooled texture, free or in use, in bytes.
+    size_t used = 0;
+
+    /// Amount of VRAM used by the textures in use, in bytes.
+    size_t in_use = 0;
+
+    /// Highest values of used and in_use since the last reset_high_water.
+    size_t high_water = 0;
+    size_t in_use_high_water = 0;
+
+    uint32_t tick = 0;
+    std::vector<Entry> entries;
+
+    /**
+     * Initialize a TexturePool
+     * @param _budget max amount of VRAM used by the textures, in bytes, 0 means no limit.
+     */
+    TexturePool(const size_t _budget = 1024 * 1024)
+    {
+        budget = _budget;
+    }
+
+    ~TexturePool()
+    {
+        clear();
+    }
+
+    /// Round a texture side up to the size the pool creates.
+    static int pooled_size(const int n)
+    {
+        int size = 16;
+        while (size < n)
+            size *= 2;
+        return size;
+    }
+
+    /**
+     * Take a render target texture of at least w x h pixels, its content is undefined.
+     * @param renderer SDL_Renderer pointer to the current renderer.
+     * @returns texture, or nullptr if it couldn't be created
+     */
+    SDL_Texture *acquire(SDL_Renderer *renderer, const int w, const int h, const Uint32 format = SDL_PIXELFORMAT_RGBA8888)
+    {
+        const int pw = pooled_size(w);
+        const int ph = pooled_size(h);
+        for (Entry &e : entries)
+        {
+            if (!e.in_use && e.format == format && e.w == pw && e.h == ph)
+            {
+                e.in_use = true;
+                e.last_used = ++tick;
+                in_use += e.bytes;
+                if (in_use > in_use_high_water)
+                    in_use_high_water = in_use;
+                return e.texture;
+            }
+        }
+        return create(renderer, pw, ph, format, true);
+    }
+
+    /**
+     * Give a texture back to the pool. Textures that weren't acquired from it are destroyed.
+     */
+    void release(SDL_Texture *texture)
+    {
+        if (texture == nullptr)
+            return;
+        for (Entry &e : entries)
+        {
+            if (e.texture == texture)
+            {
+                if (e.in_use)
+                    in_use -= e.bytes;
+                e.in_use = false;
+                e.last_used = ++tick;
+                return;
+            }
+        }
+        SIMPLE_TEXT_COUNT(texture_destroys, 1);
+        SDL_DestroyTexture(texture);
+    }
+
+    /**
+     * Create free textures ahead of time, e.g. while a scene loads.
+     * @param count amount of free textures of this size the pool should hold.
+     */
+    void reserve(SDL_Renderer *renderer, const int w, const int h, const int count, const Uint32 format = SDL_PIXELFORMAT_RGBA8888)
+    {
+        const int pw = pooled_size(w);
+        const int ph = pooled_size(h);
+        int free = 0;
+        for (const Entry &e : entries)
+            free += !e.in_use && e.format == format && e.w == pw && e.h == ph;
+        for (; free < count; free++)
+        {
+            if (create(renderer, pw, ph, format, false) == nullptr)
+                return;
+        }
+    }
+
+    /// Destroy every free texture, e.g. when the scene changes.
+    void compact()
+    {
+        for (size_t i = entries.size(); i-- > 0;)
+        {
+            if (!entries[i].in_use)
+                evict(i);
+        }
+    }
+
+    /// Destroy every texture, the ones in use too.
+    void clear()
+    {
+        while (!entries.empty())
+            evict(entries.size() - 1);
+        in_use = 0;
+    }
+
+    /// Start tracking the high-water marks from the current usage.
+    void reset_high_water()
+    {
+        high_water = used;
+        in_use_high_water = in_use;
+    }
+
+    /**
+     * Create a texture owned by the pool, evicting free textures to make room.
+     * @param taken whether the texture is handed out right away.
+     */
+    SDL_Texture *create(SDL_Renderer *renderer, const int w, const int h, const Uint32 format, const bool taken)
+    {
+        const size_t bytes = (size_t)w * h * SDL_BYTESPERPIXEL(format);
+        while (budget != 0 && used + bytes > budget)
+        {
+            int oldest = -1;
+            for (int i = 0; i < (int)entries.size(); i++)
+            {
+                if (!entries[i].in_use && (oldest == -1 || entries[i].last_used < entries[oldest].last_used))
+                    oldest = i;
+            }
+            if (oldest == -1)
+                break;
+            evict(oldest);
+        }
+        if (!taken && budget != 0 && used + bytes > budget)
+            return nullptr;
+
+        SIMPLE_TEXT_COUNT(texture_creates, 1);
+        SDL_Texture *texture = SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_TARGET, w, h);
+        if (texture == nullptr)
+            return nullptr;
+        Entry e;
+        e.texture = texture;
+        e.format = format;
+        e.w = w;
+        e.h = h;
+        e.bytes = bytes;
+        e.in_use = taken;
+        e.last_used = ++tick;
+        entries.push_back(e);
+        used += bytes;
+        if (used > high_water)
+            high_water = used;
+        if (taken)
+        {
+            in_use += bytes;
+            if (in_use > in_use_high_water)
+                in_use_high_water = in_use;
+        }
+        return texture;
+    }
+
+    /// Destroy a pooled texture.
+    void evict(const size_t i)
+    {
+        used -= entries[i].bytes;
+        if (entries[i].in_use)
+            in_use -= entries[i].bytes;
+        SIMPLE_TEXT_COUNT(texture_destroys, 1);
+        SDL_DestroyTexture(entries[i].texture);
+        if (i + 1 != entries.size())
+            entries[i] = entries.back();
+        entries.pop_back();
+    }
+};
+
 /**
  * @brief Struct of a SDL_Texture that can handle a text draw.
  *
- * It just stores an SDL_Texture pointer and a bool to sinalize
- * if all the text has finished being drawn on the texture.
+ * It stores an SDL_Texture pointer, the region of the screen it covers
+ * and a bool to sinalize if all the text has finished being drawn on the texture.
+ * The texture is only as big as the text drawn into it, or taken from a
+ * TexturePool if pool is set, in which case only its top left corner is used.
  */
 struct CombinedTexture
 {
@@ -48,94 +391,329 @@ struct CombinedTexture
     /// Pointer to the target texture.
     SDL_Texture *texture = nullptr;
 
+    /// Region of the screen covered by the texture.
+    SDL_Rect area = {0, 0, 0, 0};
+
+    /// Pool the texture is acquired from and released to, nullptr to own it.
+    TexturePool *pool = nullptr;
+
+    CombinedTexture(TexturePool *_pool = nullptr)
+    {
+        pool = _pool;
+    }
+
+    CombinedTexture(const CombinedTexture &) = delete;
+    CombinedTexture &operator=(const CombinedTexture &) = delete;
+
     ~CombinedTexture()
     {
-        SDL_DestroyTexture(texture);
+        release_texture(texture);
+    }
+
+    /**
+     * Create a render target texture, from the pool if there is one.
+     * @param renderer SDL_Renderer pointer to the current renderer.
+     */
+    SDL_Texture *acquire_texture(SDL_Renderer *renderer, const int w, const int h) const
+    {
+        if (pool)
+            return pool->acquire(renderer, w, h);
+        SIMPLE_TEXT_COUNT(texture_creates, 1);
+        return SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+    }
+
+    /// Give a texture back to the pool, or destroy it without one.
+    void release_texture(SDL_Texture *old) const
+    {
+        if (pool)
+        {
+            pool->release(old);
+            return;
+        }
+        SIMPLE_TEXT_COUNT(texture_destroys, old != nullptr);
+        SDL_DestroyTexture(old);
+    }
+
+    /**
+     * Draw the texture at the region it covers.
+     * @param renderer SDL_Renderer pointer to the current renderer.
+     */
+    void blit(SDL_Renderer *renderer) const
+    {
+        SIMPLE_TEXT_COUNT(render_copies, texture != nullptr);
+        const SDL_Rect used = {0, 0, area.w, area.h};
+        if (texture)
+            SDL_RenderCopy(renderer, texture, &used, &area);
+    }
+
+    /// Drop the texture, so the next draw starts a new text.
+    void reset()
+    {
+        release_texture(texture);
+        texture = nullptr;
+        finished = false;
+        area = {0, 0, 0, 0};
     }
 };
 
 /**
- * @brief Struct that stores settings of a Typewritter Effect.
+ * @brief Line of a wrapped text, as a range of bytes of the original text.
+ */
+struct LineSpan
+{
+    /// Byte offset of the first character of the line.
+    uint32_t offset;
+
+    /// Amount of bytes of the line, without the leading and trailing spaces of a wrap.
+    uint32_t length;
+
+    /// Horizontal draw size of the line in pixels.
+    int width;
+};
+
+/**
+ * @brief Single positioned character of a TextLayout.
+ */
+struct LayoutGlyph
+{
+    /// Decoded character.
+    uint32_t character;
+
+    /// Index inside the font atlas, -1 for spaces.
+    int index;
+
+    /// Position relative to the layout origin.
+    int x;
+    int y;
+
+    /// Index of the glyph quad in TextLayout::quads, for spaces the index of the next quad.
+    int quad;
+
+    /// Style run of the glyph in TextLayout::runs, 0 for layouts without markup.
+    uint16_t run = 0;
+};
+
+/**
+ * @brief Speed or pause marker of a typewriter text.
  *
- * Store the counters, timers and duration of a ingle char typing.
+ * Written inside the text as {s:x} to type x times faster from there on,
+ * or {p:x} (also {w:x}) to wait x seconds before the next character.
  */
-struct TypeStats
+struct TypeMarker
 {
-    std::vector<std::string> current_lines;
-    std::string temp_text;
-    std::vector<uint32_t> utf8_text;
-    /// Indicates the current char index.
-    int type_counter;
+    /// Glyph of the layout the marker is applied before.
+    int glyph;
 
-    /// Indicates the current horizontal position of the char.
-    int current_x;
+    /// Byte offset of the marker inside the text without markers.
+    size_t offset;
 
-    /// Needs to be updated every frame (by adding delta time).
-    float timer;
+    /// 's' for speed or 'p' for pause.
+    char kind;
 
-    /// Duration in seconds of a character typing.
-    float duration;
+    /// Speed multiplier or pause in seconds.
+    float value;
+};
 
-    TypeStats(int _tc, int _cx, int _t, int _d)
-    {
-        type_counter = _tc;
-        current_x = _cx;
-        timer = _t;
-        duration = _d;
-        current_lines.clear();
-        utf8_text.clear();
-        temp_text = "";
-    }
+/**
+ * @brief Style of a range of glyphs, set by markup.
+ */
+struct TextRun
+{
+    /// First glyph of the layout drawn with this style.
+    uint32_t first_glyph;
+
+    /// Byte offset of the run inside the text without markup.
+    uint32_t offset;
+
+    SDL_Color color;
+    int size;
+
+    /// Index of the atlas, in the list given to build_rich_layout.
+    int atlas;
 };
 
 /**
- * @brief Struct that stores a font atlas info.
+ * @brief Four floats of a glyph quad, either a box (x0, y0, x1, y1) or texture coordinates (u0, v0, u1, v1).
+ */
+struct alignas(16) GlyphQuad
+{
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+};
+
+/**
+ * @brief Struct that stores a text already wrapped and positioned.
  *
- * Store the SDL_Texture of a font atlas and also
- * it's all characters.
+ * Built once by build_text_layout() for a given text and draw settings,
+ * so drawing it again only costs the glyphs actually drawn.
  */
-struct FontAtlas
+struct TextLayout
 {
-    /// Pointer to the atlas texture.
-    SDL_Texture *atlas_texture;
+    /// Every drawable character and space, in reading order.
+    std::vector<LayoutGlyph> glyphs;
+
+    /// Index of the first glyph of each line.
+    std::vector<int> line_starts;
+
+    /// Bytes of the original text covered by each line.
+    std::vector<LineSpan> lines;
+
+    /// Destiny box of every glyph that isn't a space, relative to the layout origin.
+    std::vector<GlyphQuad> quads;
+
+    /// Normalized texture coordinates of every quad.
+    std::vector<GlyphQuad> quad_uvs;
 
-    /// Pointer to an array containing all the characters of the atlas ordered.
-    char *characters;
+    /// Glyph index inside the atlas of every quad.
+    std::vector<int> quad_glyphs;
+
+    /// Style run of every quad, only for layouts built with markup.
+    std::vector<uint16_t> quad_runs;
+
+    /// Text without markup, style runs and typewriter markers of a layout built by build_rich_layout.
+    std::string plain;
+    std::vector<TextRun> runs;
+    std::vector<TypeMarker> markers;
+
+    /// Text and settings the layout was built with.
+    const char *text_data = nullptr;
+    size_t text_size = 0;
+    int size = 0;
+    int h_offset = 0;
+    int v_offset = 0;
+    int max_width = 0;
+    bool valid = false;
 
     /**
-     * Initialize the FontAtlas
-     * @param filename path to the atlas png source file.
-     * @param renderer pointer to the current renderer.
-     * @param chars pointer to the characters array.
+     * Check if the layout was built for this text and settings.
+     * Only the text address and length are compared, so call invalidate()
+     * after editing a string in place.
      */
-    FontAtlas(const char *filename, SDL_Renderer *renderer, const char* chars)
+    bool matches(const std::string &text, const int _size, const int _h_offset, const int _v_offset, const int _max_width) const
     {
-        SDL_Surface *image = IMG_Load(filename);
-        atlas_texture = SDL_CreateTextureFromSurface(renderer, image);
-        SDL_SetTextureBlendMode(atlas_texture, SDL_BLENDMODE_BLEND);
-        characters = (char *) chars;
-        SDL_FreeSurface(image);
+        return valid &&
+               text.data() == text_data &&
+               text.size() == text_size &&
+               size == _size &&
+               h_offset == _h_offset &&
+               v_offset == _v_offset &&
+               max_width == _max_width;
     }
 
-    ~FontAtlas()
+    /// Force the next user of the layout to build it again.
+    void invalidate()
     {
-        if (characters)
-        {
-            free(characters);
-        }
-        if (atlas_texture)
+        valid = false;
+    }
+};
+
+/// Character returned by the decoder for malformed UTF-8 sequences.
+const uint32_t UTF8_INVALID = 0xFFFD;
+
+/**
+ * Decode the next character of an UTF-8 string and advance the cursor past it.
+ * Malformed sequences decode as UTF8_INVALID, one byte at a time.
+ * @param it reference to the cursor, must be lower than end.
+ * @param end pointer past the last byte of the string.
+ * @returns decoded character
+ */
+constexpr uint32_t decode_next(const char *&it, const char *end);
+
+/**
+ * Decode an UTF-8 string into a caller provided buffer.
+ * @param text UTF-8 string.
+ * @param out buffer that will receive the characters.
+ * @param capacity amount of characters that fit in out.
+ * @returns amount of characters written, never above capacity.
+ */
+size_t decode_utf8(std::string_view text, uint32_t *out, size_t capacity);
+
+/**
+ * Count the characters of an UTF-8 string without storing them.
+ * @param text UTF-8 string.
+ * @returns amount of characters
+ */
+size_t utf8_length(std::string_view text);
+
+/**
+ * Encode a character as UTF-8.
+ * @param character character to encode, invalid ones encode as UTF8_INVALID.
+ * @param out buffer with room for 4 bytes.
+ * @returns amount of bytes written
+ */
+int encode_utf8(uint32_t character, char *out);
+
+/**
+ * @brief Range over the characters of an UTF-8 string.
+ *
+ * Decodes on the fly, so it can be used in a range for
+ * without allocating any memory.
+ */
+struct Utf8Text
+{
+    std::string_view text;
+
+    struct iterator
+    {
+        /// First byte of the current character.
+        const char *pos;
+
+        /// First byte after the current character.
+        const char *next;
+
+        const char *end;
+        uint32_t current;
+
+        uint32_t operator*() const { return current; }
+
+        iterator &operator++()
         {
-            SDL_DestroyTexture(atlas_texture);
+            pos = next;
+            if (next < end)
+                current = decode_next(next, end);
+            return *this;
         }
+
+        bool operator!=(const iterator &other) const { return pos != other.pos; }
+    };
+
+    Utf8Text(std::string_view _text) : text(_text) {}
+
+    iterator begin() const
+    {
+        iterator i = {text.data(), text.data(), text.data() + text.size(), 0};
+        if (i.next < i.end)
+            i.current = decode_next(i.next, i.end);
+        return i;
+    }
+
+    iterator end() const
+    {
+        const char *e = text.data() + text.size();
+        return {e, e, e, 0};
     }
 };
 
 /**
- * Get the index of an given character.
- * @param input_string reference to the original text.
- * @returns text without newline characters
+ * @brief Range over already decoded characters.
  */
-int get_char_index(uint32_t character, const char *atlas);
+struct Utf32Text
+{
+    const uint32_t *characters;
+    size_t count;
+
+    const uint32_t *begin() const { return characters; }
+    const uint32_t *end() const { return characters + count; }
+};
+
+/**
+ * Convert an UTF-8 encoded string into a vector of characters.
+ * @param text null terminated UTF-8 string.
+ * @returns decoded characters
+ */
+std::vector<uint32_t> get_utf8_char_vector(const char *text);
 
 /**
  * Get the source rect of a character in a font atlas using the character index.
@@ -146,89 +724,5270 @@ int get_char_index(uint32_t character, const char *atlas);
  * @param cell_height height of a font atlas cell.
  * @returns source rect
  */
-SDL_Rect get_atlas_rect_by_index(const int index, const int atlas_width, const int atlas_height, const int cell_width, const int cell_height);
+constexpr SDL_Rect get_atlas_rect_by_index(const int index, const int atlas_width, const int atlas_height, const int cell_width, const int cell_height);
 
 /**
- * Remove all newline characters from a string.
- * @param input_string reference to the original text.
- * @returns text without newline characters
+ * @brief Character table of a grid atlas, built at compile time by make_atlas_table.
+ *
+ * Holds the decoded characters, their first index for characters below 256 and
+ * the source rect of every cell, for an atlas whose size is known at build time.
  */
-std::string remove_new_lines(const std::string &input_string);
+template <size_t N>
+struct AtlasTable
+{
+    /// Atlas characters as written, UTF-8.
+    const char *characters;
+
+    uint32_t codepoints[N];
+    SDL_Rect rects[N];
+    int16_t direct[256];
+    int count;
+    int texture_width;
+    int texture_height;
+    int cell_width;
+    int cell_height;
+
+    /// Index of a character inside the atlas, -1 if missing.
+    constexpr int index_of(const uint32_t character) const
+    {
+        if (character < 256)
+            return direct[character];
+        for (int i = 0; i < count; i++)
+        {
+            if (codepoints[i] == character)
+                return i;
+        }
+        return -1;
+    }
+};
+
+/**
+ * Build the character table of a grid atlas at compile time.
+ * @param chars atlas characters literal, in cell order.
+ * @param texture_w width of the atlas texture.
+ * @param texture_h height of the atlas texture.
+ * @param cell_w width of a cell.
+ * @param cell_h height of a cell.
+ * @returns table, usable as a constexpr variable
+ */
+template <size_t N>
+constexpr AtlasTable<N> make_atlas_table(const char (&chars)[N], const int texture_w, const int texture_h, const int cell_w = 32, const int cell_h = 32)
+{
+    AtlasTable<N> table{};
+    table.characters = chars;
+    table.texture_width = texture_w;
+    table.texture_height = texture_h;
+    table.cell_width = cell_w;
+    table.cell_height = cell_h;
+    for (int i = 0; i < 256; i++)
+        table.direct[i] = -1;
+    const char *it = chars;
+    const char *end = chars + N - 1;
+    while (it < end)
+    {
+        const uint32_t c = decode_next(it, end);
+        if (c < 256 && table.direct[c] == -1)
+            table.direct[c] = (int16_t)table.count;
+        table.codepoints[table.count] = c;
+        table.rects[table.count] = get_atlas_rect_by_index(table.count, texture_w, texture_h, cell_w, cell_h);
+        table.count++;
+    }
+    return table;
+}
+
+/**
+ * @brief Text line laid out at compile time by make_static_label.
+ *
+ * Stores the atlas index and pen position of every glyph, so drawing it does
+ * no decoding and no lookups. Positions use the grid advance, like atlases
+ * loaded without metrics.
+ */
+template <size_t N>
+struct StaticLabel
+{
+    int16_t glyphs[N];
+    int16_t x[N];
+    int count;
+    int width;
+    int size;
+};
+
+/**
+ * Lay out a text line at compile time for an atlas table.
+ * @param table table of the atlas the label will be drawn with.
+ * @param text text literal, characters missing from the atlas are skipped.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @returns label, usable as a constexpr variable
+ */
+template <size_t A, size_t N>
+constexpr StaticLabel<N> make_static_label(const AtlasTable<A> &table, const char (&text)[N], const int size, const int h_offset = 57)
+{
+    StaticLabel<N> label{};
+    label.size = size;
+    const int advance = size - (h_offset * size / 100);
+    int current_x = 0;
+    const char *it = text;
+    const char *end = text + N - 1;
+    while (it < end)
+    {
+        const uint32_t c = decode_next(it, end);
+        if (c == ' ')
+        {
+            current_x += advance;
+            continue;
+        }
+        const int index = table.index_of(c);
+        if (index == -1)
+            continue;
+        label.glyphs[label.count] = (int16_t)index;
+        label.x[label.count] = (int16_t)current_x;
+        label.count++;
+        current_x += advance;
+    }
+    label.width = current_x;
+    return label;
+}
+
+/**
+ * @brief Placement of a single glyph, in atlas pixels.
+ */
+struct GlyphMetrics
+{
+    /// Horizontal distance from the pen position to the glyph rect.
+    int bearing_x = 0;
+
+    /// Vertical distance from the top of the line to the glyph rect.
+    int bearing_y = 0;
+
+    /// Horizontal distance from this glyph to the next one.
+    int advance = 0;
+};
+
+/**
+ * @brief Extra horizontal adjustment between two glyphs, in atlas pixels.
+ */
+struct KerningPair
+{
+    /// Left glyph index on the high 16 bits, right glyph index on the low 16 bits.
+    uint32_t pair;
+
+    int amount;
+};
+
+/// Magic of a packed font file, "STF1" in file order.
+const uint32_t FONT_FILE_MAGIC = 0x31465453;
+
+const uint16_t FONT_FILE_VERSION = 1;
+
+/// Pixel data stored by a packed font file.
+enum FontFilePixels
+{
+    /// 4 bytes per pixel, R G B A in memory order.
+    FONT_PIXELS_RGBA8888 = 0,
+
+    /// 1 byte per pixel, index into a 256 colors palette.
+    FONT_PIXELS_T8 = 1,
+
+    /// 4 bits per pixel, index into a 16 colors palette, the first pixel on the low nibble.
+    FONT_PIXELS_T4 = 2
+};
+
+enum FontFileFlags
+{
+    /// Pixel data is swizzled in 16 bytes x 8 rows blocks, as sampled by the PSP GE.
+    FONT_FILE_SWIZZLED = 1,
+
+    /// The glyph table has proportional metrics and the file may have kerning pairs.
+    FONT_FILE_METRICS = 2,
+
+    /// FONT_PIXELS_T8 pixels hold a signed distance field, loaded as ATLAS_PIXELS_SDF.
+    FONT_FILE_SDF = 4
+};
+
+/**
+ * @brief Header of a packed font file, made by tools/font_pack.
+ *
+ * Everything is little endian. The header is followed by the tables it points to,
+ * every offset is from the start of the file and aligned to 16 bytes:
+ * glyph_count uint32_t code points, glyph_count FontFileGlyph, kerning_count
+ * FontFileKerning, the palette (16 or 256 RGBA colors, palettized formats only)
+ * and the pixels.
+ */
+struct FontFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint16_t glyph_count;
+    uint16_t pixel_format;
+    uint16_t texture_width;
+    uint16_t texture_height;
+    uint16_t cell_width;
+    uint16_t cell_height;
+    int32_t space_advance;
+    uint32_t kerning_count;
+    uint32_t codepoints_offset;
+    uint32_t glyphs_offset;
+    uint32_t kerning_offset;
+    uint32_t palette_offset;
+    uint32_t pixels_offset;
+    uint32_t pixels_size;
+};
+
+/**
+ * @brief Rect and metrics of a glyph in a packed font file, in atlas pixels.
+ */
+struct FontFileGlyph
+{
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+    int16_t bearing_x;
+    int16_t bearing_y;
+    int16_t advance;
+    int16_t reserved;
+};
+
+/**
+ * @brief Kerning pair of a packed font file, same layout as KerningPair.
+ */
+struct FontFileKerning
+{
+    uint32_t pair;
+    int32_t amount;
+};
+
+static_assert(sizeof(FontFileHeader) == 52, "FontFileHeader must match the file layout");
+static_assert(sizeof(FontFileGlyph) == 16, "FontFileGlyph must match the file layout");
+static_assert(sizeof(FontFileKerning) == 8, "FontFileKerning must match the file layout");
+
+/**
+ * Convert pixels between linear and PSP swizzled order, in blocks of 16 bytes x 8 rows.
+ * @param src source pixels.
+ * @param dst destiny pixels, must not overlap src.
+ * @param row_bytes bytes per row, multiple of 16.
+ * @param height amount of rows, multiple of 8.
+ * @param swizzle true to swizzle, false to unswizzle.
+ */
+void swizzle_pixels(const uint8_t *src, uint8_t *dst, const int row_bytes, const int height, const bool swizzle);
+
+/**
+ * Turn glyph coverage into a signed distance field, for ATLAS_PIXELS_SDF atlases.
+ * 128 is the glyph edge, 255 is spread pixels inside and 0 spread pixels outside.
+ * The search stays inside each cell, so neighbour glyphs don't leak into each other.
+ * @param coverage alpha of the atlas, 8 bits per pixel, row by row.
+ * @param out distance field, same size as coverage.
+ * @param w width of the atlas in pixels.
+ * @param h height of the atlas in pixels.
+ * @param cell_w width of a glyph cell in pixels.
+ * @param cell_h height of a glyph cell in pixels.
+ * @param spread distance in pixels covered by the field, on each side of the edge.
+ */
+void build_distance_field(const uint8_t *coverage, uint8_t *out, const int w, const int h, const int cell_w, const int cell_h, const int spread);
+
+/// Pixels kept for the glyphs of a FontAtlas.
+enum AtlasPixels
+{
+    /// The texture keeps the atlas image colors, 32 bits per pixel.
+    ATLAS_PIXELS_RGBA = 0,
+
+    /// Only the alpha is kept, 8 bits per pixel in coverage. Glyphs are white and tinted per vertex or by color mod.
+    ATLAS_PIXELS_A8 = 1,
+
+    /// Only the alpha is kept, 4 bits per pixel in coverage, the first pixel on the low nibble.
+    ATLAS_PIXELS_A4 = 2,
+
+    /// The alpha is a signed distance field (see build_distance_field), kept like ATLAS_PIXELS_A8.
+    /// Sampled with linear filtering and cut at its edge by the GE alpha test on PSP with
+    /// SIMPLE_TEXT_GU, or by a shader with SIMPLE_TEXT_SDF_GL, one small atlas stays sharp at every size.
+    ATLAS_PIXELS_SDF = 3
+};
+
+/// Frame counter, incremented by text_frame_begin. Atlas pages used during the current frame are never evicted.
+uint32_t text_frame_index = 0;
+
+/**
+ * @brief One texture of a paged FontAtlas, loaded when one of its glyphs is first drawn.
+ */
+struct AtlasPage
+{
+    /// Path to the page png source file.
+    std::string filename;
+
+    /// Page texture, nullptr while the page isn't loaded.
+    SDL_Texture *texture = nullptr;
+
+    /// Index of the first glyph of the page, glyphs of a page are contiguous.
+    int first_glyph = 0;
+
+    /// Amount of glyphs in the page.
+    int glyph_count = 0;
+
+    /// Texture memory of the page when loaded.
+    size_t bytes = 0;
+
+    /// Value of text_frame_index when the page was last used.
+    uint32_t last_used = 0;
+
+    /// Set when the file couldn't be loaded, so it isn't retried every glyph.
+    bool failed = false;
+
+    /// Glyph coverage of the page when the atlas doesn't use ATLAS_PIXELS_RGBA.
+    std::vector<uint8_t> coverage;
+};
+
+#if defined(__psp__) && defined(SIMPLE_TEXT_GU)
+/**
+ * @brief Copy of a glyph coverage in the layout sampled by the GE: swizzled,
+ * power of two sized and palettized (T8 or T4) with an alpha ramp CLUT.
+ */
+struct GuTexture
+{
+    /// Texture the copy was made for, the copy is rebuilt when it changes.
+    SDL_Texture *source = nullptr;
+
+    /// Swizzled texels, 16 bytes aligned.
+    uint8_t *texels = nullptr;
+
+    /// CLUT of 16 or 256 ABGR colors, 16 bytes aligned.
+    uint32_t *clut = nullptr;
+
+    /// GU_PSM_T8 or GU_PSM_T4.
+    int psm = GU_PSM_T8;
+
+    /// Power of two size of the texture in pixels.
+    int width = 0;
+    int height = 0;
+
+    GuTexture() = default;
+    GuTexture(const GuTexture &) = delete;
+    GuTexture &operator=(const GuTexture &) = delete;
+
+    GuTexture(GuTexture &&other)
+    {
+        *this = static_cast<GuTexture &&>(other);
+    }
+
+    GuTexture &operator=(GuTexture &&other)
+    {
+        if (this != &other)
+        {
+            release();
+            source = other.source;
+            texels = other.texels;
+            clut = other.clut;
+            psm = other.psm;
+            width = other.width;
+            height = other.height;
+            other.texels = nullptr;
+            other.clut = nullptr;
+            other.source = nullptr;
+        }
+        return *this;
+    }
+
+    ~GuTexture()
+    {
+        release();
+    }
+
+    void release()
+    {
+        free(texels);
+        free(clut);
+        texels = nullptr;
+        clut = nullptr;
+        source = nullptr;
+    }
+
+    /**
+     * Build the copy from a linear coverage buffer, see AtlasPixels.
+     * @param coverage A8 or A4 coverage, row by row.
+     * @param w width of the coverage in pixels.
+     * @param h height of the coverage in pixels.
+     * @param four_bits true for A4 coverage, false for A8.
+     * @returns true if the copy was built.
+     */
+    bool build(const uint8_t *coverage, const int w, const int h, const bool four_bits)
+    {
+        release();
+        // Swizzled rows are 16 byte blocks and the GE samples up to 512x512.
+        width = four_bits ? 32 : 16;
+        while (width < w)
+            width *= 2;
+        height = 8;
+        while (height < h)
+            height *= 2;
+        if (width > 512 || height > 512)
+            return false;
+
+        psm = four_bits ? GU_PSM_T4 : GU_PSM_T8;
+        const int row_bytes = four_bits ? width / 2 : width;
+        const int source_row = four_bits ? (w + 1) / 2 : w;
+        const size_t size = (size_t)row_bytes * height;
+        uint8_t *linear = (uint8_t *)calloc(size, 1);
+        texels = (uint8_t *)memalign(16, size);
+        const int entries = four_bits ? 16 : 256;
+        clut = (uint32_t *)memalign(16, entries * 4);
+        if (linear == nullptr || texels == nullptr || clut == nullptr)
+        {
+            free(linear);
+            release();
+            return false;
+        }
+        for (int y = 0; y < h; y++)
+            memcpy(linear + (size_t)y * row_bytes, coverage + (size_t)y * source_row, source_row);
+        swizzle_pixels(linear, texels, row_bytes, height, true);
+        free(linear);
+        for (int i = 0; i < entries; i++)
+            clut[i] = (uint32_t)(i * 255 / (entries - 1)) << 24 | 0x00FFFFFF;
+
+        sceKernelDcacheWritebackRange(texels, size);
+        sceKernelDcacheWritebackRange(clut, entries * 4);
+        return true;
+    }
+
+    /// Bind the texture and its CLUT for the following draws.
+    void bind() const
+    {
+        const int entries = psm == GU_PSM_T4 ? 16 : 256;
+        sceGuClutMode(GU_PSM_8888, 0, entries - 1, 0);
+        sceGuClutLoad(entries / 8, clut);
+        sceGuTexMode(psm, 0, 0, 1);
+        sceGuTexImage(0, width, height, width, texels);
+        sceGuTexFlush();
+    }
+};
+
+/**
+ * @brief Vertex of a GU_SPRITES glyph, two per glyph, in the
+ * GU_TEXTURE_16BIT | GU_COLOR_8888 | GU_VERTEX_16BIT | GU_TRANSFORM_2D format.
+ */
+struct GuGlyphVertex
+{
+    uint16_t u;
+    uint16_t v;
+    uint32_t color;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    int16_t pad;
+};
+
+static_assert(sizeof(GuGlyphVertex) == 16, "GuGlyphVertex must match the GE vertex format");
+#endif
+
+/**
+ * @brief Struct that stores a font atlas info.
+ *
+ * Store the SDL_Texture of a font atlas and also
+ * it's all characters. A font atlas can also be split in pages,
+ * each its own texture, loaded on demand and evicted under a memory budget.
+ */
+struct FontAtlas
+{
+    /// Pointer to the atlas texture, nullptr for a paged atlas.
+    SDL_Texture *atlas_texture = nullptr;
+
+    /// RGBA32 copy of the glyphs as atlas_texture holds them, kept instead of the
+    /// texture when the atlas is created without a renderer, for the raster_* functions.
+    SDL_Surface *headless_image = nullptr;
+
+    /// Copy of all the characters of the atlas ordered, owned by the atlas.
+    char *characters = nullptr;
+
+    /// Glyph index of every character below 256, -1 when the atlas doesn't have it.
+    int16_t direct_glyphs[256];
+
+    /// Open addressing table keys for the characters above 255 (0 means empty slot).
+    std::vector<uint32_t> extra_keys;
+
+    /// Glyph indices matching each slot of extra_keys.
+    std::vector<int16_t> extra_glyphs;
+
+    /// Amount of bits used to address extra_keys.
+    int extra_bits = 0;
+
+    /// Amount of characters in the atlas.
+    int glyph_count = 0;
+
+    /// Size of the atlas texture in pixels.
+    int texture_width = 0;
+    int texture_height = 0;
+
+    /// Size of a glyph cell in pixels, a font size draws a cell_height tall glyph at that size.
+    int cell_width = 32;
+    int cell_height = 32;
+
+    /// Source rect of every glyph inside the atlas texture.
+    std::vector<SDL_Rect> glyph_rects;
+
+    /// Normalized texture coordinates of every glyph, as used by SDL_RenderGeometry.
+    std::vector<SDL_FRect> glyph_uvs;
+
+    /// Proportional metrics of every glyph, empty when the atlas is monospaced.
+    std::vector<GlyphMetrics> glyph_metrics;
+
+    /// Kerning pairs sorted by pair, only used with glyph_metrics.
+    std::vector<KerningPair> kerning_pairs;
+
+    /// Advance of the space character in atlas pixels, only used with glyph_metrics.
+    int space_advance = 0;
+
+    /// Pages of a paged atlas, empty when the atlas is a single texture.
+    mutable std::vector<AtlasPage> pages;
+
+    /// Page of every glyph, only used with pages.
+    std::vector<uint16_t> glyph_pages;
+
+    /// Renderer used to load pages on demand.
+    SDL_Renderer *page_renderer = nullptr;
+
+    /// Max texture memory of the loaded pages in bytes, 0 means no limit.
+    size_t vram_budget = 0;
+
+    /// Texture memory of the loaded pages in bytes.
+    mutable size_t vram_used = 0;
+
+    /// Incremented every time a page is evicted, so vertices built before can be detected as stale.
+    mutable uint32_t page_generation = 0;
+
+    /// Color mod applied to every texture of the atlas.
+    mutable SDL_Color color_mod = {255, 255, 255, 255};
+
+    /// Pixels kept for the glyphs, see AtlasPixels.
+    int pixel_format = ATLAS_PIXELS_RGBA;
+
+    /// Glyph coverage of atlas_texture, row by row, when pixel_format isn't ATLAS_PIXELS_RGBA.
+    std::vector<uint8_t> coverage;
+
+    /// Texture memory of atlas_texture in bytes.
+    size_t texture_bytes = 0;
+
+#if defined(__psp__) && defined(SIMPLE_TEXT_GU)
+    /// GE copies of the coverage, one per page (or one for atlas_texture), built on first use.
+    mutable std::vector<GuTexture> gu_textures;
+#endif
+
+    /**
+     * Initialize the FontAtlas
+     * @param filename path to the atlas png source file.
+     * @param renderer pointer to the current renderer.
+     * @param chars pointer to the characters array.
+     * @param cell_w width of a font atlas cell.
+     * @param cell_h height of a font atlas cell.
+     * @param pixels pixels kept for the glyphs, see AtlasPixels.
+     */
+    FontAtlas(const char *filename, SDL_Renderer *renderer, const char* chars, const int cell_w = 32, const int cell_h = 32, const int pixels = ATLAS_PIXELS_RGBA)
+    {
+        pixel_format = pixels;
+        load(filename, renderer, chars);
+        cell_width = cell_w;
+        cell_height = cell_h;
+        build_glyph_rects(nullptr);
+    }
+
+    /**
+     * Initialize the FontAtlas from a packed atlas, where every glyph has its own rect.
+     * @param filename path to the atlas png source file.
+     * @param renderer pointer to the current renderer.
+     * @param chars pointer to the characters array.
+     * @param rects source rect of each character of chars, in the same order.
+     * @param cell_h height in pixels that matches the font size when drawing.
+     * @param pixels pixels kept for the glyphs, see AtlasPixels.
+     */
+    FontAtlas(const char *filename, SDL_Renderer *renderer, const char* chars, const SDL_Rect *rects, const int cell_h, const int pixels = ATLAS_PIXELS_RGBA)
+    {
+        pixel_format = pixels;
+        load(filename, renderer, chars);
+        cell_width = cell_h;
+        cell_height = cell_h;
+        build_glyph_rects(rects);
+    }
+
+    /**
+     * Initialize a paged FontAtlas. Every page is a grid of cells with the same size,
+     * and no page is loaded until one of its glyphs is drawn or preloaded.
+     * @param renderer pointer to the current renderer, used to load the pages later.
+     * @param filenames path to the png source file of every page.
+     * @param page_characters characters of every page, ordered like the cells of the page.
+     * @param page_count amount of pages.
+     * @param page_width width of every page texture in pixels.
+     * @param page_height height of every page texture in pixels.
+     * @param cell_w width of a font atlas cell.
+     * @param cell_h height of a font atlas cell.
+     * @param budget max texture memory of the loaded pages in bytes, 0 means no limit.
+     * @param pixels pixels kept for the glyphs, see AtlasPixels.
+     */
+    FontAtlas(SDL_Renderer *renderer,
+              const char *const *filenames,
+              const char *const *page_characters,
+              const int page_count,
+              const int page_width,
+              const int page_height,
+              const int cell_w = 32,
+              const int cell_h = 32,
+              const size_t budget = 0,
+              const int pixels = ATLAS_PIXELS_RGBA)
+    {
+        pixel_format = pixels;
+        page_renderer = renderer;
+        vram_budget = budget;
+        texture_width = page_width;
+        texture_height = page_height;
+        cell_width = cell_w;
+        cell_height = cell_h;
+
+        size_t length = 0;
+        for (int p = 0; p < page_count; p++)
+            length += strlen(page_characters[p]);
+        characters = (char *)malloc(length + 1);
+        if (characters == nullptr)
+            return;
+        characters[0] = '\0';
+
+        pages.resize(page_count);
+        int first = 0;
+        char *it = characters;
+        for (int p = 0; p < page_count; p++)
+        {
+            const size_t size = strlen(page_characters[p]);
+            memcpy(it, page_characters[p], size);
+            it += size;
+            pages[p].filename = filenames[p];
+            pages[p].first_glyph = first;
+            pages[p].glyph_count = (int)utf8_length(std::string_view(page_characters[p], size));
+            first += pages[p].glyph_count;
+        }
+        *it = '\0';
+
+        build_glyph_index();
+        glyph_pages.resize(glyph_count);
+        for (int p = 0; p < page_count; p++)
+        {
+            for (int i = 0; i < pages[p].glyph_count; i++)
+                glyph_pages[pages[p].first_glyph + i] = (uint16_t)p;
+        }
+        build_glyph_rects(nullptr);
+    }
+
+    /**
+     * Initialize the FontAtlas from a packed font file made by tools/font_pack,
+     * read with a single file read and no image decoding.
+     * @param filename path to the packed font file.
+     * @param renderer pointer to the current renderer.
+     */
+    FontAtlas(const char *filename, SDL_Renderer *renderer)
+    {
+        size_t length = 0;
+        void *data = SDL_LoadFile(filename, &length);
+        if (data == nullptr)
+            return;
+        load_font_data(renderer, data, length);
+        SDL_free(data);
+    }
+
+    /**
+     * Initialize the FontAtlas from a packed font file already in memory.
+     * The buffer is only read during the call, so it can be released right after.
+     * @param renderer pointer to the current renderer.
+     * @param data contents of the packed font file.
+     * @param length size of data in bytes.
+     */
+    FontAtlas(SDL_Renderer *renderer, const void *data, const size_t length)
+    {
+        load_font_data(renderer, data, length);
+    }
+
+    /**
+     * Initialize the FontAtlas from a table built at compile time by make_atlas_table,
+     * so the characters aren't parsed again. The rects are rebuilt if the texture
+     * size doesn't match the table.
+     * @param filename path to the atlas png source file.
+     * @param renderer pointer to the current renderer.
+     * @param table character table of the atlas.
+     * @param pixels how the glyphs are kept, see AtlasPixels.
+     */
+    template <size_t N>
+    FontAtlas(const char *filename, SDL_Renderer *renderer, const AtlasTable<N> &table, const int pixels = ATLAS_PIXELS_RGBA)
+    {
+        pixel_format = pixels;
+        load_texture(filename, renderer);
+        const size_t length = strlen(table.characters);
+        characters = (char *)malloc(length + 1);
+        if (characters)
+            memcpy(characters, table.characters, length + 1);
+        build_glyph_index(Utf32Text{table.codepoints, (size_t)table.count});
+        cell_width = table.cell_width;
+        cell_height = table.cell_height;
+        const bool same_size = texture_width == table.texture_width && texture_height == table.texture_height;
+        build_glyph_rects(same_size ? table.rects : nullptr);
+    }
+
+    FontAtlas(const FontAtlas &) = delete;
+    FontAtlas &operator=(const FontAtlas &) = delete;
+
+    /**
+     * Load the atlas texture and build the character lookup tables.
+     * @param filename path to the atlas png source file.
+     * @param renderer pointer to the current renderer.
+     * @param chars pointer to the characters array.
+     */
+    void load(const char *filename, SDL_Renderer *renderer, const char* chars)
+    {
+        load_texture(filename, renderer);
+        const size_t length = strlen(chars);
+        characters = (char *)malloc(length + 1);
+        if (characters)
+            memcpy(characters, chars, length + 1);
+        build_glyph_index();
+    }
+
+    /**
+     * Load the atlas texture and read its size.
+     * @param filename path to the atlas png source file.
+     * @param renderer pointer to the current renderer.
+     */
+    void load_texture(const char *filename, SDL_Renderer *renderer)
+    {
+        SDL_Surface *image = IMG_Load(filename);
+        if (renderer == nullptr)
+        {
+            keep_headless_image(image);
+            SDL_FreeSurface(image);
+            return;
+        }
+        atlas_texture = create_glyph_texture(renderer, image, coverage, texture_bytes);
+        if (SDL_QueryTexture(atlas_texture, nullptr, nullptr, &texture_width, &texture_height) != 0)
+        {
+            texture_width = 0;
+            texture_height = 0;
+        }
+        SDL_FreeSurface(image);
+    }
+
+    /**
+     * Load the glyph tables and texture from a packed font file in memory.
+     * @param renderer pointer to the current renderer.
+     * @param data contents of the packed font file.
+     * @param length size of data in bytes.
+     * @returns true if the file is valid and the texture was created.
+     */
+    bool load_font_data(SDL_Renderer *renderer, const void *data, const size_t length)
+    {
+        const uint8_t *bytes = (const uint8_t *)data;
+        FontFileHeader header;
+        if (length < sizeof(header))
+            return false;
+        memcpy(&header, bytes, sizeof(header));
+        if (header.magic != FONT_FILE_MAGIC || header.version != FONT_FILE_VERSION)
+            return false;
+
+        const int w = header.texture_width;
+        const int h = header.texture_height;
+        int row_bytes = w * 4;
+        int palette_size = 0;
+        if (header.pixel_format == FONT_PIXELS_T8)
+        {
+            row_bytes = w;
+            palette_size = 256;
+        }
+        else if (header.pixel_format == FONT_PIXELS_T4)
+        {
+            row_bytes = (w + 1) / 2;
+            palette_size = 16;
+        }
+        else if (header.pixel_format != FONT_PIXELS_RGBA8888)
+        {
+            return false;
+        }
+
+        const bool swizzled = (header.flags & FONT_FILE_SWIZZLED) != 0;
+        if (swizzled && (row_bytes % 16 != 0 || h % 8 != 0))
+            return false;
+        auto fits = [&](const uint32_t offset, const size_t size)
+        {
+            return offset <= length && size <= length - offset;
+        };
+        if (!fits(header.codepoints_offset, (size_t)header.glyph_count * 4) ||
+            !fits(header.glyphs_offset, (size_t)header.glyph_count * sizeof(FontFileGlyph)) ||
+            !fits(header.kerning_offset, (size_t)header.kerning_count * sizeof(FontFileKerning)) ||
+            !fits(header.palette_offset, (size_t)palette_size * 4) ||
+            !fits(header.pixels_offset, header.pixels_size) ||
+            header.pixels_size < (size_t)row_bytes * h)
+            return false;
+
+        // Glyph positions divide by the cell size, kerning() binary searches the pairs.
+        const bool metrics = (header.flags & FONT_FILE_METRICS) != 0;
+        if (header.cell_width == 0 || header.cell_height == 0)
+            return false;
+        uint32_t previous_pair = 0;
+        for (uint32_t i = 0; metrics && i < header.kerning_count; i++)
+        {
+            FontFileKerning k;
+            memcpy(&k, bytes + header.kerning_offset + i * sizeof(k), sizeof(k));
+            if (i > 0 && k.pair < previous_pair)
+                return false;
+            previous_pair = k.pair;
+        }
+
+        // Characters, encoded back to UTF-8 so the lookup tables are built as usual.
+        // A 0 codepoint would end the text early.
+        const uint8_t *codepoints = bytes + header.codepoints_offset;
+        char *text = (char *)malloc((size_t)header.glyph_count * 4 + 1);
+        if (text == nullptr)
+            return false;
+        size_t text_length = 0;
+        for (int i = 0; i < header.glyph_count; i++)
+        {
+            uint32_t c;
+            memcpy(&c, codepoints + i * 4, 4);
+            if (c == 0)
+            {
+                free(text);
+                return false;
+            }
+            text_length += encode_utf8(c, text + text_length);
+        }
+        text[text_length] = '\0';
+        if (characters)
+            free(characters);
+        characters = text;
+        build_glyph_index();
+
+        texture_width = w;
+        texture_height = h;
+        cell_width = header.cell_width;
+        cell_height = header.cell_height;
+
+        std::vector<SDL_Rect> rects(glyph_count);
+        glyph_metrics.assign(metrics ? glyph_count : 0, GlyphMetrics());
+        for (int i = 0; i < glyph_count; i++)
+        {
+            FontFileGlyph g;
+            memcpy(&g, bytes + header.glyphs_offset + i * sizeof(g), sizeof(g));
+            rects[i] = {g.x, g.y, g.w, g.h};
+            if (metrics)
+                glyph_metrics[i] = {g.bearing_x, g.bearing_y, g.advance};
+        }
+        build_glyph_rects(rects.data());
+
+        kerning_pairs.clear();
+        space_advance = header.space_advance;
+        if (metrics)
+        {
+            kerning_pairs.resize(header.kerning_count);
+            for (size_t i = 0; i < kerning_pairs.size(); i++)
+            {
+                FontFileKerning k;
+                memcpy(&k, bytes + header.kerning_offset + i * sizeof(k), sizeof(k));
+                kerning_pairs[i] = {k.pair, k.amount};
+            }
+        }
+
+        // The SDL path wants linear RGBA, swizzled and palettized data is expanded here.
+        const uint8_t *pixels = bytes + header.pixels_offset;
+        uint8_t *linear = nullptr;
+        if (swizzled)
+        {
+            linear = (uint8_t *)malloc((size_t)row_bytes * h);
+            if (linear == nullptr)
+                return false;
+            swizzle_pixels(pixels, linear, row_bytes, h, false);
+            pixels = linear;
+        }
+        uint8_t *rgba = nullptr;
+        if (palette_size > 0)
+        {
+            rgba = (uint8_t *)malloc((size_t)w * h * 4);
+            if (rgba == nullptr)
+            {
+                free(linear);
+                return false;
+            }
+            const uint8_t *palette = bytes + header.palette_offset;
+            for (int y = 0; y < h; y++)
+            {
+                const uint8_t *row = pixels + (size_t)y * row_bytes;
+                uint8_t *out = rgba + (size_t)y * w * 4;
+                for (int x = 0; x < w; x++)
+                {
+                    const int index = header.pixel_format == FONT_PIXELS_T4 ? (row[x / 2] >> ((x & 1) * 4)) & 0x0F : row[x];
+                    memcpy(out + x * 4, palette + index * 4, 4);
+                }
+            }
+            pixels = rgba;
+        }
+
+        SIMPLE_TEXT_COUNT(texture_destroys, atlas_texture != nullptr);
+        if (atlas_texture)
+            SDL_DestroyTexture(atlas_texture);
+        pixel_format = header.pixel_format == FONT_PIXELS_T8 ? ATLAS_PIXELS_A8 : (header.pixel_format == FONT_PIXELS_T4 ? ATLAS_PIXELS_A4 : ATLAS_PIXELS_RGBA);
+        if (pixel_format == ATLAS_PIXELS_A8 && (header.flags & FONT_FILE_SDF))
+            pixel_format = ATLAS_PIXELS_SDF;
+        SDL_Surface *image = SDL_CreateRGBSurfaceWithFormatFrom((void *)pixels, w, h, 32, w * 4, SDL_PIXELFORMAT_RGBA32);
+        if (renderer)
+            atlas_texture = create_glyph_texture(renderer, image, coverage, texture_bytes);
+        else
+            keep_headless_image(image);
+        SDL_FreeSurface(image);
+        free(rgba);
+        free(linear);
+        return renderer ? atlas_texture != nullptr : headless_image != nullptr;
+    }
+
+    /**
+     * Keep an RGBA32 copy of the atlas image for headless drawing, with the
+     * colors and alpha precision the glyph texture would have. Distance fields are cut
+     * at their edge, as the nearest sampling of the raster_* functions can't scale them.
+     * @param image source image in any format, nullptr fails.
+     */
+    void keep_headless_image(SDL_Surface *image)
+    {
+        SDL_FreeSurface(headless_image);
+        headless_image = image ? SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA32, 0) : nullptr;
+        if (headless_image == nullptr)
+        {
+            texture_width = 0;
+            texture_height = 0;
+            return;
+        }
+        texture_width = headless_image->w;
+        texture_height = headless_image->h;
+        if (pixel_format == ATLAS_PIXELS_RGBA)
+            return;
+        SDL_LockSurface(headless_image);
+        for (int y = 0; y < headless_image->h; y++)
+        {
+            uint8_t *row = (uint8_t *)headless_image->pixels + (size_t)y * headless_image->pitch;
+            for (int x = 0; x < headless_image->w; x++)
+            {
+                uint8_t *texel = row + x * 4;
+                if (pixel_format == ATLAS_PIXELS_A4)
+                    texel[3] = (uint8_t)((texel[3] * 15 + 127) / 255 * 17);
+                else if (pixel_format == ATLAS_PIXELS_SDF)
+                    texel[3] = texel[3] >= 128 ? 255 : 0;
+                texel[0] = 255;
+                texel[1] = 255;
+                texel[2] = 255;
+            }
+        }
+        SDL_UnlockSurface(headless_image);
+    }
+
+    /**
+     * Create a glyph texture from an image. With an alpha pixel format only the coverage
+     * is kept, in RAM, and the texture is white so the color comes from the vertices or
+     * the color mod. It is 16 bits per pixel when the renderer supports ABGR4444,
+     * except for distance fields.
+     * @param renderer pointer to the current renderer.
+     * @param image source image in any format, nullptr fails.
+     * @param out_coverage vector receiving the coverage, cleared with ATLAS_PIXELS_RGBA.
+     * @param bytes receives the texture memory in bytes.
+     * @returns texture, nullptr on failure
+     */
+    SDL_Texture *create_glyph_texture(SDL_Renderer *renderer, SDL_Surface *image, std::vector<uint8_t> &out_coverage, size_t &bytes) const
+    {
+        out_coverage.clear();
+        bytes = 0;
+        if (image == nullptr)
+            return nullptr;
+        SDL_Texture *texture = nullptr;
+        if (pixel_format == ATLAS_PIXELS_RGBA)
+        {
+            SIMPLE_TEXT_COUNT(texture_creates, 1);
+            texture = SDL_CreateTextureFromSurface(renderer, image);
+            bytes = (size_t)image->w * image->h * 4;
+        }
+        else
+        {
+            SDL_Surface *rgba = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA32, 0);
+            if (rgba == nullptr)
+                return nullptr;
+            const int w = rgba->w;
+            const int h = rgba->h;
+            const bool eight_bits = pixel_format != ATLAS_PIXELS_A4;
+            const int row_bytes = eight_bits ? w : (w + 1) / 2;
+            const bool packed = packs_texels(renderer);
+            out_coverage.assign((size_t)row_bytes * h, 0);
+            std::vector<uint8_t> texels((size_t)w * h * (packed ? 2 : 4));
+            SDL_LockSurface(rgba);
+            for (int y = 0; y < h; y++)
+            {
+                const uint8_t *row = (const uint8_t *)rgba->pixels + (size_t)y * rgba->pitch;
+                uint8_t *cover = out_coverage.data() + (size_t)y * row_bytes;
+                for (int x = 0; x < w; x++)
+                {
+                    const uint8_t alpha = row[x * 4 + 3];
+                    const uint8_t alpha4 = (uint8_t)((alpha * 15 + 127) / 255);
+                    if (eight_bits)
+                        cover[x] = alpha;
+                    else
+                        cover[x / 2] |= (uint8_t)(alpha4 << ((x & 1) * 4));
+
+                    const size_t i = (size_t)y * w + x;
+                    if (packed)
+                    {
+                        const uint16_t texel = (uint16_t)(alpha4 << 12 | 0x0FFF);
+                        memcpy(&texels[i * 2], &texel, 2);
+                    }
+                    else
+                    {
+                        texels[i * 4 + 0] = 255;
+                        texels[i * 4 + 1] = 255;
+                        texels[i * 4 + 2] = 255;
+                        texels[i * 4 + 3] = eight_bits ? alpha : (uint8_t)(alpha4 * 17);
+                    }
+                }
+            }
+            SDL_UnlockSurface(rgba);
+            SDL_FreeSurface(rgba);
+
+            SIMPLE_TEXT_COUNT(texture_creates, 1);
+            texture = SDL_CreateTexture(renderer, packed ? SDL_PIXELFORMAT_ABGR4444 : SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, w, h);
+            if (texture)
+                SDL_UpdateTexture(texture, nullptr, texels.data(), w * (packed ? 2 : 4));
+            bytes = texels.size();
+        }
+        if (texture)
+            SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        if (texture && pixel_format == ATLAS_PIXELS_SDF)
+            SDL_SetTextureScaleMode(texture, SDL_ScaleModeLinear);
+        return texture;
+    }
+
+    /**
+     * Check if create_glyph_texture stores the texels as ABGR4444 instead of RGBA32.
+     * 4 bits are too coarse for a distance field, it stays 32 bits per pixel.
+     * @param renderer pointer to the renderer.
+     * @returns true for 2 bytes per texel, false for 4.
+     */
+    bool packs_texels(SDL_Renderer *renderer) const
+    {
+        return pixel_format != ATLAS_PIXELS_RGBA && pixel_format != ATLAS_PIXELS_SDF &&
+               supports_format(renderer, SDL_PIXELFORMAT_ABGR4444);
+    }
+
+    /**
+     * Check if a renderer can create textures of a pixel format.
+     * @param renderer pointer to the renderer.
+     * @param format SDL_PixelFormatEnum value.
+     * @returns true if the format is supported.
+     */
+    static bool supports_format(SDL_Renderer *renderer, const Uint32 format)
+    {
+        SDL_RendererInfo info;
+        if (SDL_GetRendererInfo(renderer, &info) != 0)
+            return false;
+        for (Uint32 i = 0; i < info.num_texture_formats; i++)
+        {
+            if (info.texture_formats[i] == format)
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * Get the destiny rect of a glyph drawn at a given position and font size.
+     * @param index glyph index inside the atlas.
+     * @param x position X inside the current renderer context.
+     * @param y position Y inside the current renderer context.
+     * @param size size of the font when drawing.
+     * @returns destiny rect
+     */
+    SDL_Rect glyph_destiny(const int index, const int x, const int y, const int size) const
+    {
+        const SDL_Rect &src = glyph_rects[index];
+        if (!glyph_metrics.empty())
+        {
+            const GlyphMetrics &m = glyph_metrics[index];
+            return {x + m.bearing_x * size / cell_height,
+                    y + m.bearing_y * size / cell_height,
+                    src.w * size / cell_height,
+                    src.h * size / cell_height};
+        }
+        if (src.h == cell_height && src.w == cell_width && cell_width == cell_height)
+            return {x, y, size, size};
+        return {x, y, src.w * size / cell_height, src.h * size / cell_height};
+    }
+
+    /**
+     * Get the horizontal distance from a glyph to the next one.
+     * Without metrics every glyph advances by the same amount, set by h_offset.
+     * @param index glyph index inside the atlas, -1 for a space.
+     * @param size size of the font when drawing.
+     * @param h_offset horizontal offset between characters in percentage, only used without metrics.
+     * @returns advance in pixels
+     */
+    int glyph_advance(const int index, const int size, const int h_offset) const
+    {
+        if (glyph_metrics.empty())
+            return size - (h_offset * size / 100);
+        const int advance = index == -1 ? space_advance : glyph_metrics[index].advance;
+        return advance * size / cell_height;
+    }
+
+    /**
+     * Get the kerning adjustment between two glyphs.
+     * @param left glyph index on the left, -1 for none.
+     * @param right glyph index on the right, -1 for none.
+     * @param size size of the font when drawing.
+     * @returns adjustment in pixels
+     */
+    int kerning(const int left, const int right, const int size) const
+    {
+        if (kerning_pairs.empty() || left < 0 || right < 0)
+            return 0;
+        const uint32_t pair = ((uint32_t)left << 16) | (uint32_t)right;
+        size_t low = 0;
+        size_t high = kerning_pairs.size();
+        while (low < high)
+        {
+            const size_t mid = (low + high) / 2;
+            if (kerning_pairs[mid].pair < pair)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        if (low < kerning_pairs.size() && kerning_pairs[low].pair == pair)
+            return kerning_pairs[low].amount * size / cell_height;
+        return 0;
+    }
+
+    /**
+     * Load proportional metrics from a text sidecar file. Each line is one of:
+     *
+     *     glyph <character> <x> <y> <w> <h> <bearing_x> <bearing_y> <advance>
+     *     kern <left character> <right character> <amount>
+     *     space <advance>
+     *
+     * Characters are code points (decimal or 0x hex), everything else is in atlas pixels.
+     * Lines starting with # are ignored, and so are characters missing from the atlas.
+     * Glyphs without a glyph line keep their cell and advance by the cell width.
+     * @param filename path to the metrics file.
+     * @returns true if the file was loaded.
+     */
+    bool load_metrics(const char *filename)
+    {
+        size_t length = 0;
+        char *data = (char *)SDL_LoadFile(filename, &length);
+        if (data == nullptr)
+            return false;
+
+        glyph_metrics.assign(glyph_count, GlyphMetrics());
+        for (int i = 0; i < glyph_count; i++)
+            glyph_metrics[i].advance = glyph_rects[i].w;
+        kerning_pairs.clear();
+        space_advance = cell_width / 2;
+
+        char *line = data;
+        char *end = data + length;
+        while (line < end)
+        {
+            char *line_end = line;
+            while (line_end < end && *line_end != '\n')
+                line_end++;
+            *line_end = '\0';
+
+            long v[8];
+            char *it = line;
+            while (*it == ' ' || *it == '\t')
+                it++;
+            if (strncmp(it, "glyph", 5) == 0 && parse_numbers(it + 5, v, 8))
+            {
+                const int index = glyph_index((uint32_t)v[0]);
+                if (index != -1)
+                {
+                    glyph_rects[index] = {(int)v[1], (int)v[2], (int)v[3], (int)v[4]};
+                    glyph_metrics[index].bearing_x = (int)v[5];
+                    glyph_metrics[index].bearing_y = (int)v[6];
+                    glyph_metrics[index].advance = (int)v[7];
+                }
+            }
+            else if (strncmp(it, "kern", 4) == 0 && parse_numbers(it + 4, v, 3))
+            {
+                const int left = glyph_index((uint32_t)v[0]);
+                const int right = glyph_index((uint32_t)v[1]);
+                if (left != -1 && right != -1)
+                    kerning_pairs.push_back({((uint32_t)left << 16) | (uint32_t)right, (int)v[2]});
+            }
+            else if (strncmp(it, "space", 5) == 0 && parse_numbers(it + 5, v, 1))
+            {
+                space_advance = (int)v[0];
+            }
+            line = line_end + 1;
+        }
+        SDL_free(data);
+
+        // Insertion sort, files are usually written already sorted.
+        for (size_t i = 1; i < kerning_pairs.size(); i++)
+        {
+            KerningPair k = kerning_pairs[i];
+            size_t j = i;
+            while (j > 0 && kerning_pairs[j - 1].pair > k.pair)
+            {
+                kerning_pairs[j] = kerning_pairs[j - 1];
+                j--;
+            }
+            kerning_pairs[j] = k;
+        }
+
+        const SDL_Rect *rects = glyph_rects.data();
+        std::vector<SDL_Rect> tight(rects, rects + glyph_count);
+        build_glyph_rects(tight.data());
+        return true;
+    }
+
+    /**
+     * Parse whitespace separated integers.
+     * @param text null terminated text.
+     * @param values array that will receive the numbers.
+     * @param count amount of numbers expected.
+     * @returns true if all the numbers were found.
+     */
+    static bool parse_numbers(const char *text, long *values, const int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            char *next;
+            values[i] = strtol(text, &next, 0);
+            if (next == text)
+                return false;
+            text = next;
+        }
+        return true;
+    }
+
+    /**
+     * Fill the source rect and texture coordinate tables.
+     * @param rects source rect of every glyph, or nullptr to use a grid of cell_width x cell_height cells.
+     */
+    void build_glyph_rects(const SDL_Rect *rects)
+    {
+        glyph_rects.resize(glyph_count);
+        glyph_uvs.resize(glyph_count);
+        const int cells_per_row = cell_width > 0 ? texture_width / cell_width : 0;
+        for (int i = 0; i < glyph_count; i++)
+        {
+            // Cells are counted from the first glyph of the page.
+            const int cell = pages.empty() ? i : i - pages[glyph_pages[i]].first_glyph;
+            if (rects)
+                glyph_rects[i] = rects[i];
+            else if (cells_per_row > 0)
+                glyph_rects[i] = get_atlas_rect_by_index(cell, texture_width, texture_height, cell_width, cell_height);
+            else
+                glyph_rects[i] = {0, 0, 0, 0};
+
+            const SDL_Rect &r = glyph_rects[i];
+            if (texture_width > 0 && texture_height > 0)
+            {
+                glyph_uvs[i] = {(float)r.x / texture_width,
+                                (float)r.y / texture_height,
+                                (float)r.w / texture_width,
+                                (float)r.h / texture_height};
+            }
+            else
+            {
+                glyph_uvs[i] = {0.0f, 0.0f, 0.0f, 0.0f};
+            }
+        }
+    }
+
+    ~FontAtlas()
+    {
+        if (characters)
+        {
+            free(characters);
+        }
+        SDL_FreeSurface(headless_image);
+        if (atlas_texture)
+        {
+            SIMPLE_TEXT_COUNT(texture_destroys, 1);
+            SDL_DestroyTexture(atlas_texture);
+        }
+        for (auto &page : pages)
+        {
+            SIMPLE_TEXT_COUNT(texture_destroys, page.texture != nullptr);
+            if (page.texture)
+                SDL_DestroyTexture(page.texture);
+        }
+    }
+
+    /**
+     * Get the texture a glyph is drawn from, loading its page if needed.
+     * @param index glyph index inside the atlas.
+     * @returns texture, nullptr if its page couldn't be loaded
+     */
+    SDL_Texture *glyph_texture(const int index) const
+    {
+        if (pages.empty())
+            return atlas_texture;
+        return page_texture(glyph_pages[index]);
+    }
+
+    /**
+     * Get the page of a glyph.
+     * @param index glyph index inside the atlas.
+     * @returns page index, always 0 when the atlas is a single texture
+     */
+    int glyph_page(const int index) const
+    {
+        return pages.empty() ? 0 : glyph_pages[index];
+    }
+
+#if defined(__psp__) && defined(SIMPLE_TEXT_GU)
+    /**
+     * Get the GE copy of a page, loading the page and building the copy if needed.
+     * @param page page index, 0 when the atlas is a single texture.
+     * @returns texture, nullptr when the atlas keeps no coverage (ATLAS_PIXELS_RGBA) or on failure
+     */
+    const GuTexture *gu_texture(const int page) const
+    {
+        if (pixel_format == ATLAS_PIXELS_RGBA)
+            return nullptr;
+        SDL_Texture *source = pages.empty() ? atlas_texture : page_texture(page);
+        const std::vector<uint8_t> &cover = pages.empty() ? coverage : pages[page].coverage;
+        if (source == nullptr || cover.empty())
+            return nullptr;
+        if ((int)gu_textures.size() <= page)
+            gu_textures.resize(page + 1);
+        GuTexture &texture = gu_textures[page];
+        if (texture.source != source)
+        {
+            if (!texture.build(cover.data(), texture_width, texture_height, pixel_format == ATLAS_PIXELS_A4))
+                return nullptr;
+            texture.source = source;
+        }
+        return &texture;
+    }
+#endif
+
+    /**
+     * Get the texture of a page, loading it if needed, and mark it as used this frame.
+     * @param page page index.
+     * @returns texture, nullptr if the page couldn't be loaded
+     */
+    SDL_Texture *page_texture(const int page) const
+    {
+        AtlasPage &p = pages[page];
+        p.last_used = text_frame_index;
+        if (p.texture == nullptr && !p.failed)
+            load_page(page);
+        return p.texture;
+    }
+
+    /**
+     * Load the texture of a page, evicting the least recently used pages to stay under the budget.
+     * @param page page index.
+     * @returns true if the page was loaded.
+     */
+    bool load_page(const int page) const
+    {
+        return attach_page(page, IMG_Load(pages[page].filename.c_str()));
+    }
+
+    /**
+     * Upload a page image decoded somewhere else, e.g. by a TextWorker.
+     * @param page index of the page.
+     * @param image decoded page, freed here. nullptr marks the page as failed.
+     * @returns true if the page has a texture
+     */
+    bool attach_page(const int page, SDL_Surface *image) const
+    {
+        AtlasPage &p = pages[page];
+        if (image == nullptr)
+        {
+            p.failed = true;
+            return false;
+        }
+        if (p.texture)
+        {
+            SDL_FreeSurface(image);
+            return true;
+        }
+        const size_t bytes = (size_t)image->w * image->h * (packs_texels(page_renderer) ? 2 : 4);
+        evict_pages(bytes);
+        size_t created = 0;
+        p.texture = create_glyph_texture(page_renderer, image, p.coverage, created);
+        SDL_FreeSurface(image);
+        if (p.texture == nullptr)
+        {
+            p.failed = true;
+            return false;
+        }
+        SDL_SetTextureColorMod(p.texture, color_mod.r, color_mod.g, color_mod.b);
+        p.bytes = created;
+        p.failed = false;
+        p.last_used = text_frame_index;
+        vram_used += created;
+        return true;
+    }
+
+    /**
+     * Evict least recently used pages until a new page fits in the budget.
+     * Pages used during the current frame are kept, even if that goes over the budget.
+     * @param incoming bytes of the page about to be loaded.
+     */
+    void evict_pages(const size_t incoming) const
+    {
+        if (vram_budget == 0)
+            return;
+        while (vram_used + incoming > vram_budget)
+        {
+            int oldest = -1;
+            for (int i = 0; i < (int)pages.size(); i++)
+            {
+                const AtlasPage &p = pages[i];
+                if (p.texture == nullptr || p.last_used == text_frame_index)
+                    continue;
+                if (oldest == -1 || p.last_used < pages[oldest].last_used)
+                    oldest = i;
+            }
+            if (oldest == -1)
+                return;
+            SIMPLE_TEXT_COUNT(texture_destroys, 1);
+            SDL_DestroyTexture(pages[oldest].texture);
+            pages[oldest].texture = nullptr;
+            std::vector<uint8_t>().swap(pages[oldest].coverage);
+            vram_used -= pages[oldest].bytes;
+            page_generation++;
+        }
+    }
+
+    /**
+     * Load every page needed to draw a text, e.g. the text of the first screen.
+     * @param text UTF-8 text.
+     * @returns true if all the pages needed were loaded.
+     */
+    bool preload(std::string_view text) const
+    {
+        bool loaded = true;
+        for (auto c : Utf8Text(text))
+        {
+            const int index = glyph_index(c);
+            if (index != -1 && glyph_texture(index) == nullptr)
+                loaded = false;
+        }
+        return loaded;
+    }
+
+    /**
+     * Set the color mod of every texture of the atlas, pages loaded later get it too.
+     * @param color new color mod.
+     * @returns previous color mod
+     */
+    SDL_Color set_color_mod(const SDL_Color color) const
+    {
+        const SDL_Color previous = color_mod;
+        color_mod = color;
+        if (atlas_texture)
+            SDL_SetTextureColorMod(atlas_texture, color.r, color.g, color.b);
+        for (auto &page : pages)
+        {
+            if (page.texture)
+                SDL_SetTextureColorMod(page.texture, color.r, color.g, color.b);
+        }
+        return previous;
+    }
+
+    /**
+     * Get the index of a character inside the atlas.
+     * Runs in constant time and never allocates.
+     * @param character utf8 character.
+     * @returns glyph index, or -1 if the atlas doesn't have the character.
+     */
+    int glyph_index(uint32_t character) const
+    {
+        SIMPLE_TEXT_COUNT(glyph_lookups, 1);
+        if (character < 256)
+            return direct_glyphs[character];
+        if (extra_bits == 0)
+            return -1;
+        const uint32_t mask = (1u << extra_bits) - 1;
+        uint32_t slot = (character * 0x9E3779B1u) >> (32 - extra_bits);
+        while (extra_keys[slot] != 0)
+        {
+            if (extra_keys[slot] == character)
+                return extra_glyphs[slot];
+            slot = (slot + 1) & mask;
+        }
+        return -1;
+    }
+
+    /**
+     * Build the character lookup tables from the atlas characters.
+     * Called once by the constructor.
+     */
+    void build_glyph_index()
+    {
+        if (characters == nullptr)
+        {
+            build_glyph_index(Utf32Text{nullptr, 0});
+            return;
+        }
+        build_glyph_index(Utf8Text(characters));
+    }
+
+    /**
+     * Build the lookup tables from the atlas characters in order.
+     * @param utf8_atlas range over the characters, Utf8Text or Utf32Text.
+     */
+    template <typename Characters>
+    void build_glyph_index(const Characters &utf8_atlas)
+    {
+        for (int i = 0; i < 256; i++)
+            direct_glyphs[i] = -1;
+        extra_keys.clear();
+        extra_glyphs.clear();
+        extra_bits = 0;
+        glyph_count = 0;
+
+        int extra_count = 0;
+        for (auto c : utf8_atlas)
+        {
+            if (c >= 256)
+                extra_count++;
+        }
+        if (extra_count > 0)
+        {
+            // Keep the table at most half full so probes stay short.
+            extra_bits = 1;
+            while ((1 << extra_bits) < extra_count * 2)
+                extra_bits++;
+            extra_keys.assign(1 << extra_bits, 0);
+            extra_glyphs.assign(1 << extra_bits, -1);
+        }
+
+        const uint32_t mask = (1u << extra_bits) - 1;
+        int i = 0;
+        for (auto c : utf8_atlas)
+        {
+            if (c < 256)
+            {
+                if (direct_glyphs[c] == -1)
+                    direct_glyphs[c] = i;
+                i++;
+                continue;
+            }
+            uint32_t slot = (c * 0x9E3779B1u) >> (32 - extra_bits);
+            while (extra_keys[slot] != 0 && extra_keys[slot] != c)
+                slot = (slot + 1) & mask;
+            if (extra_keys[slot] == 0)
+            {
+                extra_keys[slot] = c;
+                extra_glyphs[slot] = i;
+            }
+            i++;
+        }
+        glyph_count = i;
+    }
+};
+
+#ifndef SIMPLE_TEXT_ARENA_SIZE
+/// Initial size of the frame arena, it grows to the peak usage of previous frames.
+#define SIMPLE_TEXT_ARENA_SIZE (16 * 1024)
+#endif
+
+#ifndef SIMPLE_TEXT_STREAM_CHUNK
+/// Bytes of script a TextStream reads at a time, longer lines are cut.
+#define SIMPLE_TEXT_STREAM_CHUNK 4096
+#endif
+
+#ifndef SIMPLE_TEXT_WARMUP_FRAMES
+/// Frames after start where heap allocations are expected, see text_frame_end.
+#define SIMPLE_TEXT_WARMUP_FRAMES 2
+#endif
+
+#ifdef SIMPLE_TEXT_COUNT_ALLOCS
+/// Amount of general heap allocations (operator new) since start.
+size_t text_heap_allocations = 0;
+
+void *operator new(size_t size)
+{
+    if (!text_stats_disabled)
+    {
+        text_heap_allocations++;
+        SIMPLE_TEXT_COUNT(bytes_allocated, size);
+    }
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size)
+{
+    if (!text_stats_disabled)
+    {
+        text_heap_allocations++;
+        SIMPLE_TEXT_COUNT(bytes_allocated, size);
+    }
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+void operator delete[](void *memory) noexcept { free(memory); }
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+void operator delete[](void *memory, size_t) noexcept { free(memory); }
+#endif
+
+/**
+ * @brief Bump allocator for text scratch memory.
+ *
+ * Allocations are released all at once, either by text_frame_begin or by rolling
+ * back to a mark. When a frame needs more than the arena has, the missing memory
+ * comes from malloc and the arena grows to fit at the next reset, so after a few
+ * frames it stops allocating.
+ */
+struct TextArena
+{
+    /// Memory taken from malloc when the arena is full.
+    struct Overflow
+    {
+        Overflow *next;
+        size_t start;
+        size_t size;
+    };
+
+    unsigned char *memory = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    Overflow *overflow = nullptr;
+    size_t overflow_bytes = 0;
+
+    /// Highest amount of bytes in use since the last reset.
+    size_t peak = 0;
+
+    /// Frames left where heap allocations don't trigger the assert of text_frame_end.
+    int warmup = SIMPLE_TEXT_WARMUP_FRAMES;
+
+    /// Heap allocation count when the frame started.
+    size_t frame_allocations = 0;
+
+    ~TextArena()
+    {
+        release(0);
+        free(memory);
+    }
+
+    /**
+     * Get memory valid until the arena is reset or rolled back before it.
+     * @param bytes amount of bytes.
+     * @param align alignment, must be a power of two up to 16.
+     * @returns pointer to the memory, nullptr if malloc failed
+     */
+    void *allocate(const size_t bytes, const size_t align = 8)
+    {
+        SIMPLE_TEXT_COUNT(bytes_allocated, bytes);
+        const size_t offset = (used + align - 1) & ~(align - 1);
+        if (overflow == nullptr && offset + bytes <= capacity)
+        {
+            used = offset + bytes;
+            if (used > peak)
+                peak = used;
+            return memory + offset;
+        }
+
+        // Once an overflow block exists every allocation gets its own, so marks stay ordered.
+        const size_t header = (sizeof(Overflow) + 15) & ~(size_t)15;
+        Overflow *block = (Overflow *)malloc(header + bytes);
+        if (block == nullptr)
+            return nullptr;
+        block->next = overflow;
+        block->start = mark();
+        block->size = bytes;
+        overflow = block;
+        overflow_bytes += bytes;
+        if (used + overflow_bytes > peak)
+            peak = used + overflow_bytes;
+        return (unsigned char *)block + header;
+    }
+
+    /// Get the current position, to roll back to it with release.
+    size_t mark() const
+    {
+        return used + overflow_bytes;
+    }
+
+    /**
+     * Release everything allocated after a mark.
+     * @param position value returned by mark.
+     */
+    void release(const size_t position)
+    {
+        while (overflow != nullptr && overflow->start >= position)
+        {
+            Overflow *next = overflow->next;
+            overflow_bytes -= overflow->size;
+            free(overflow);
+            overflow = next;
+        }
+        if (position < used)
+            used = position;
+    }
+
+    /// Release everything, growing the arena if the last frames didn't fit.
+    void reset()
+    {
+        release(0);
+        size_t wanted = peak > SIMPLE_TEXT_ARENA_SIZE ? peak : SIMPLE_TEXT_ARENA_SIZE;
+        if (wanted > capacity)
+        {
+            wanted = (wanted + 1023) & ~(size_t)1023;
+            unsigned char *grown = (unsigned char *)malloc(wanted);
+            if (grown != nullptr)
+            {
+                free(memory);
+                memory = grown;
+                capacity = wanted;
+            }
+        }
+        used = 0;
+        peak = 0;
+    }
+};
+
+/// Arena used by the library and by text_frame_alloc / text_frame_format.
+TextArena text_frame_arena;
+
+/**
+ * Start a frame, releasing all the scratch memory of the previous one.
+ */
+void text_frame_begin();
+
+/**
+ * End a frame. With SIMPLE_TEXT_COUNT_ALLOCS defined it asserts that the frame
+ * didn't allocate from the general heap, after SIMPLE_TEXT_WARMUP_FRAMES frames.
+ * Set text_frame_arena.warmup to skip the assert for a few frames, e.g. when loading new text.
+ * @returns amount of heap allocations during the frame, always 0 without SIMPLE_TEXT_COUNT_ALLOCS
+ */
+size_t text_frame_end();
+
+/**
+ * Get an uninitialized array valid until the next text_frame_begin.
+ * @param count amount of elements.
+ * @returns pointer to the array, nullptr if out of memory
+ */
+template <typename T>
+T *text_frame_alloc(const size_t count)
+{
+    return (T *)text_frame_arena.allocate(count * sizeof(T), alignof(T) < 16 ? alignof(T) : 16);
+}
+
+/**
+ * Format a text with printf syntax into the frame arena.
+ * @returns the text, valid until the next text_frame_begin
+ */
+std::string_view text_frame_format(const char *format, ...);
+
+/// Time in nanoseconds the budgeted text work (layout builds, typewriter reveals, page uploads)
+/// may take per frame, 0 for no limit. Work left over budget is pushed to the next frame.
+uint64_t text_frame_budget_ns = 0;
+
+/// Time spent on budgeted text work since text_frame_begin.
+uint64_t text_frame_spent_ns = 0;
+
+/// @returns true if the budgeted text work of this frame can still start
+inline bool text_budget_left()
+{
+    return text_frame_budget_ns == 0 || text_frame_spent_ns < text_frame_budget_ns;
+}
+
+/// Adds the time of its scope to text_frame_spent_ns.
+struct TextBudgetTimer
+{
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    ~TextBudgetTimer()
+    {
+        static const uint64_t frequency = SDL_GetPerformanceFrequency();
+        text_frame_spent_ns += (SDL_GetPerformanceCounter() - start) * 1000000000ull / frequency;
+    }
+};
+
+/**
+ * @brief Histogram of frame times, for keeping a stable frame rate on hardware.
+ *
+ * Frames are counted in fixed 0.25 ms buckets up to 50 ms, slower ones in the last
+ * bucket, so adding a frame never allocates and percentiles are read from the counts.
+ */
+struct FrameTimes
+{
+    static constexpr int BUCKETS = 200;
+    static constexpr uint64_t BUCKET_NS = 250000;
+
+    uint32_t counts[BUCKETS + 1] = {};
+    uint32_t frames = 0;
+    uint64_t min_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t total_ns = 0;
+
+    /// Performance counter of the last tick, 0 before the first one.
+    uint64_t last_tick = 0;
+
+    /// Count a frame that took ns nanoseconds.
+    void add(const uint64_t ns)
+    {
+        const uint64_t bucket = ns / BUCKET_NS;
+        counts[bucket < BUCKETS ? bucket : BUCKETS]++;
+        min_ns = frames == 0 || ns < min_ns ? ns : min_ns;
+        max_ns = ns > max_ns ? ns : max_ns;
+        total_ns += ns;
+        frames++;
+    }
+
+    /**
+     * Count the time since the previous tick as a frame, call it once per frame after presenting.
+     * @returns the frame time in nanoseconds, 0 on the first call
+     */
+    uint64_t tick()
+    {
+        static const uint64_t frequency = SDL_GetPerformanceFrequency();
+        const uint64_t now = SDL_GetPerformanceCounter();
+        const uint64_t ns = last_tick == 0 ? 0 : (now - last_tick) * 1000000000ull / frequency;
+        if (last_tick != 0)
+            add(ns);
+        last_tick = now;
+        return ns;
+    }
+
+    /// Forget every frame, e.g. after loading a scene.
+    void reset()
+    {
+        const uint64_t tick = last_tick;
+        *this = FrameTimes();
+        last_tick = tick;
+    }
+
+    uint64_t average_ns() const
+    {
+        return frames == 0 ? 0 : total_ns / frames;
+    }
+
+    /**
+     * @param fraction part of the frames, 0.99 for the 99th percentile.
+     * @returns upper bound of the bucket holding the percentile, max_ns for the last bucket
+     */
+    uint64_t percentile_ns(const float fraction) const
+    {
+        const uint32_t wanted = (uint32_t)(frames * fraction + 0.5f);
+        uint32_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++)
+        {
+            seen += counts[i];
+            if (seen >= wanted && seen > 0)
+            {
+                const uint64_t bound = (uint64_t)(i + 1) * BUCKET_NS;
+                return bound < max_ns ? bound : max_ns;
+            }
+        }
+        return max_ns;
+    }
+
+    uint64_t p99_ns() const
+    {
+        return percentile_ns(0.99f);
+    }
+
+    /// @returns amount of frames slower than ns, rounded up to the buckets
+    uint32_t frames_over(const uint64_t ns) const
+    {
+        uint32_t over = 0;
+        for (int i = (int)((ns + BUCKET_NS - 1) / BUCKET_NS); i <= BUCKETS; i++)
+            over += counts[i];
+        return over;
+    }
+};
+
+/**
+ * Draw the min, average and 99th percentile frame times, and the frames slower than 60 fps.
+ * @param times FrameTimes filled with tick().
+ * @param font_atlas FontAtlas reference used to draw the overlay.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X of the line.
+ * @param y position Y of the line.
+ * @param size size of the font when drawing.
+ * @param color Color of the text in RGB format.
+ */
+void draw_frame_times(const FrameTimes &times,
+                      const FontAtlas &font_atlas,
+                      SDL_Renderer *renderer,
+                      const int x,
+                      const int y,
+                      const int size = 12,
+                      SDL_Color color = {255, 255, 0});
+
+#ifdef SIMPLE_TEXT_STATS
+/**
+ * Get the counters of the last frame, between the last two text_frame_begin calls.
+ * @returns copy of the counters
+ */
+TextStats text_stats_snapshot();
+
+/**
+ * Draw the counters of the last frame as a few lines of text.
+ * The overlay itself is counted in the current frame.
+ * @param font_atlas FontAtlas reference used to draw the overlay.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X of the first line.
+ * @param y position Y of the first line.
+ * @param size size of the font when drawing.
+ * @param color Color of the text in RGB format.
+ */
+void draw_text_stats(const FontAtlas &font_atlas,
+                     SDL_Renderer *renderer,
+                     const int x,
+                     const int y,
+                     const int size = 12,
+                     SDL_Color color = {255, 255, 0});
+#endif
+
+/**
+ * @brief Drop shadow and outline drawn under a text.
+ *
+ * They are extra copies of the glyph quads with an offset and a color, queued
+ * in the same TextBatch bucket before the text, so they go out in the same
+ * draw call without decoding or looking up the text again.
+ */
+struct TextEffect
+{
+    /// Offset of the shadow in pixels, no shadow if both are 0.
+    int shadow_x = 0;
+    int shadow_y = 0;
+    SDL_Color shadow_color = {0, 0, 0, 160};
+
+    /// Width of the outline in pixels, no outline if 0.
+    int outline = 0;
+    SDL_Color outline_color = {0, 0, 0, 255};
+
+    /**
+     * Get the offset and color of every copy, in draw order.
+     * @returns amount of copies, at most 9
+     */
+    int copies(float *dx, float *dy, SDL_Color *colors) const
+    {
+        int count = 0;
+        if (shadow_x != 0 || shadow_y != 0)
+        {
+            dx[count] = (float)shadow_x;
+            dy[count] = (float)shadow_y;
+            colors[count++] = shadow_color;
+        }
+        if (outline > 0)
+        {
+            static const int directions[8][2] = {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+            for (const auto &d : directions)
+            {
+                dx[count] = (float)(d[0] * outline);
+                dy[count] = (float)(d[1] * outline);
+                colors[count++] = outline_color;
+            }
+        }
+        return count;
+    }
+};
+
+/**
+ * Build a drop shadow effect.
+ * @param x offset X of the shadow in pixels.
+ * @param y offset Y of the shadow in pixels.
+ * @param color color of the shadow, its alpha is kept.
+ */
+inline TextEffect make_text_shadow(const int x, const int y, const SDL_Color color = {0, 0, 0, 160})
+{
+    TextEffect effect;
+    effect.shadow_x = x;
+    effect.shadow_y = y;
+    effect.shadow_color = color;
+    return effect;
+}
+
+/**
+ * Build an outline effect, 8 copies of the text around it.
+ * @param width width of the outline in pixels.
+ * @param color color of the outline, its alpha is kept.
+ */
+inline TextEffect make_text_outline(const int width, const SDL_Color color = {0, 0, 0, 255})
+{
+    TextEffect effect;
+    effect.outline = width;
+    effect.outline_color = color;
+    return effect;
+}
+
+#ifdef SIMPLE_TEXT_SDF_GL
+struct TextBatch;
+
+/**
+ * Draw a batch of distance field glyphs with a fragment shader that cuts the field
+ * at its edge, smoothed over one pixel. Needs the SDL opengl renderer.
+ * @returns false when the shader isn't available, the caller should draw through SDL.
+ */
+bool sdf_gl_draw(const TextBatch &batch, SDL_Renderer *renderer);
+#endif
+
+/**
+ * @brief Struct that collects glyph quads to be sent with SDL_RenderGeometry.
+ *
+ * Quads are grouped by texture, so a whole frame of text costs
+ * a single draw call per atlas texture. The buffers keep their
+ * capacity between flushes.
+ */
+struct TextBatch
+{
+    struct Bucket
+    {
+        SDL_Texture *texture = nullptr;
+        std::vector<SDL_Vertex> vertices;
+        std::vector<int> indices;
+    };
+
+    /// One bucket per texture used since the last flush.
+    std::vector<Bucket> buckets;
+
+    /// Amount of buckets holding quads, the rest are kept for reuse.
+    size_t used_buckets = 0;
+
+    /// Set when quads of an ATLAS_PIXELS_SDF atlas are queued, so draw cuts the field at
+    /// its edge with SIMPLE_TEXT_SDF_GL. A batch shouldn't mix them with other atlases.
+    bool distance_field = false;
+
+    /**
+     * Get the bucket of a texture, starting a new one if needed.
+     * @param texture texture the quads will be sampled from.
+     * @returns bucket reference
+     */
+    Bucket &bucket(SDL_Texture *texture)
+    {
+        for (size_t i = 0; i < used_buckets; i++)
+        {
+            if (buckets[i].texture == texture)
+                return buckets[i];
+        }
+        if (used_buckets == buckets.size())
+            buckets.emplace_back();
+        Bucket &b = buckets[used_buckets++];
+        b.texture = texture;
+        return b;
+    }
+
+    /**
+     * Add a textured quad to the batch.
+     * @param texture texture the quad will be sampled from.
+     * @param texture_width width of the texture in pixels.
+     * @param texture_height height of the texture in pixels.
+     * @param source source rect inside the texture.
+     * @param destiny destiny rect inside the current renderer context.
+     * @param color color of the four vertices.
+     */
+    void add_quad(SDL_Texture *texture,
+                  const int texture_width,
+                  const int texture_height,
+                  const SDL_Rect &source,
+                  const SDL_Rect &destiny,
+                  const SDL_Color color)
+    {
+        const SDL_FRect uv = {(float)source.x / texture_width,
+                              (float)source.y / texture_height,
+                              (float)source.w / texture_width,
+                              (float)source.h / texture_height};
+        add_quad(texture, uv, destiny, color);
+    }
+
+    /**
+     * Add a textured quad using normalized texture coordinates.
+     * @param texture texture the quad will be sampled from.
+     * @param uv normalized source rect inside the texture.
+     * @param destiny destiny rect inside the current renderer context.
+     * @param color color of the four vertices.
+     */
+    void add_quad(SDL_Texture *texture, const SDL_FRect &uv, const SDL_Rect &destiny, const SDL_Color color)
+    {
+        Bucket &b = bucket(texture);
+        const float u0 = uv.x;
+        const float v0 = uv.y;
+        const float u1 = uv.x + uv.w;
+        const float v1 = uv.y + uv.h;
+        const float x0 = (float)destiny.x;
+        const float y0 = (float)destiny.y;
+        const float x1 = (float)(destiny.x + destiny.w);
+        const float y1 = (float)(destiny.y + destiny.h);
+
+        const int first = (int)b.vertices.size();
+        b.vertices.push_back({{x0, y0}, color, {u0, v0}});
+        b.vertices.push_back({{x1, y0}, color, {u1, v0}});
+        b.vertices.push_back({{x1, y1}, color, {u1, v1}});
+        b.vertices.push_back({{x0, y1}, color, {u0, v1}});
+
+        b.indices.push_back(first);
+        b.indices.push_back(first + 1);
+        b.indices.push_back(first + 2);
+        b.indices.push_back(first);
+        b.indices.push_back(first + 2);
+        b.indices.push_back(first + 3);
+    }
+
+    /**
+     * Append quads to be written by the caller, indices are filled here.
+     * @param texture texture the quads will be sampled from.
+     * @param count amount of quads.
+     * @returns pointer to the 4 * count vertices to write, in the add_quad order
+     */
+    SDL_Vertex *reserve_quads(SDL_Texture *texture, const size_t count)
+    {
+        Bucket &b = bucket(texture);
+        const int first = (int)b.vertices.size();
+        b.vertices.resize(first + count * 4);
+        const size_t index = b.indices.size();
+        b.indices.resize(index + count * 6);
+        int *it = b.indices.data() + index;
+        for (size_t i = 0; i < count; i++)
+        {
+            const int v = first + (int)i * 4;
+            it[0] = v;
+            it[1] = v + 1;
+            it[2] = v + 2;
+            it[3] = v;
+            it[4] = v + 2;
+            it[5] = v + 3;
+            it += 6;
+        }
+        return b.vertices.data() + first;
+    }
+
+    /// Vertex count of every bucket when begin_effect was called.
+    std::vector<size_t> effect_marks;
+
+    /// Mark the start of a text, so apply_effect finds the quads queued after it.
+    void begin_effect()
+    {
+        effect_marks.resize(used_buckets);
+        for (size_t i = 0; i < used_buckets; i++)
+            effect_marks[i] = buckets[i].vertices.size();
+    }
+
+    /**
+     * Copy the quads queued since begin_effect as shadow and outline quads, placed
+     * in front of them in their buckets so the text is drawn on top.
+     * @param effect shadow and outline of the text.
+     */
+    void apply_effect(const TextEffect &effect)
+    {
+        float dx[9];
+        float dy[9];
+        SDL_Color colors[9];
+        const int copies = effect.copies(dx, dy, colors);
+        if (copies == 0)
+            return;
+        for (size_t i = 0; i < used_buckets; i++)
+        {
+            Bucket &b = buckets[i];
+            const size_t start = i < effect_marks.size() ? effect_marks[i] : 0;
+            const size_t count = b.vertices.size() - start;
+            if (count == 0)
+                continue;
+
+            // Every quad has the same index pattern, so indices are only appended.
+            reserve_quads(b.texture, count / 4 * copies);
+            SDL_Vertex *text = b.vertices.data() + start;
+            memmove(text + count * copies, text, count * sizeof(SDL_Vertex));
+            const SDL_Vertex *source = text + count * copies;
+            for (int c = 0; c < copies; c++)
+            {
+                SDL_Vertex *out = text + count * c;
+                for (size_t v = 0; v < count; v++)
+                {
+                    out[v] = source[v];
+                    out[v].position.x += dx[c];
+                    out[v].position.y += dy[c];
+                    out[v].color = colors[c];
+                }
+            }
+        }
+        effect_marks.clear();
+    }
+
+    /// Drop every queued quad, keeping the allocated memory.
+    void clear()
+    {
+        for (size_t i = 0; i < used_buckets; i++)
+        {
+            buckets[i].vertices.clear();
+            buckets[i].indices.clear();
+            buckets[i].texture = nullptr;
+        }
+        used_buckets = 0;
+        distance_field = false;
+    }
+
+    /**
+     * Draw every queued quad, one SDL_RenderGeometry call per texture, keeping them queued.
+     * @param renderer SDL_Renderer pointer to the current renderer.
+     */
+    void draw(SDL_Renderer *renderer) const
+    {
+        SIMPLE_TEXT_TIME_DRAW;
+#ifdef SIMPLE_TEXT_SDF_GL
+        if (distance_field && sdf_gl_draw(*this, renderer))
+            return;
+#endif
+        for (size_t i = 0; i < used_buckets; i++)
+        {
+            const Bucket &b = buckets[i];
+            if (b.indices.empty())
+                continue;
+            SIMPLE_TEXT_COUNT(geometry_draws, 1);
+            SIMPLE_TEXT_COUNT(glyphs_drawn, b.indices.size() / 6);
+            SDL_RenderGeometry(renderer,
+                               b.texture,
+                               b.vertices.data(),
+                               (int)b.vertices.size(),
+                               b.indices.data(),
+                               (int)b.indices.size());
+        }
+    }
+
+    /**
+     * Draw every queued quad, one SDL_RenderGeometry call per texture, and clear the batch.
+     * @param renderer SDL_Renderer pointer to the current renderer.
+     */
+    void flush(SDL_Renderer *renderer)
+    {
+        draw(renderer);
+        clear();
+    }
+
+    /**
+     * Move every queued quad.
+     * @param dx horizontal distance in pixels.
+     * @param dy vertical distance in pixels.
+     */
+    void translate(const float dx, const float dy)
+    {
+        for (size_t i = 0; i < used_buckets; i++)
+        {
+            for (auto &v : buckets[i].vertices)
+            {
+                v.position.x += dx;
+                v.position.y += dy;
+            }
+        }
+    }
+
+    /// Amount of memory used by the queued quads, in bytes.
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < used_buckets; i++)
+        {
+            total += buckets[i].vertices.capacity() * sizeof(SDL_Vertex);
+            total += buckets[i].indices.capacity() * sizeof(int);
+        }
+        return total;
+    }
+};
+
+/**
+ * @brief Struct that stores settings of a Typewritter Effect.
+ *
+ * Store the counters, timers and duration of a ingle char typing.
+ */
+struct TypeStats
+{
+    /// Layout of the text being typed, rebuilt only when the text or settings change.
+    TextLayout layout;
+
+    /// Quads of the glyphs revealed in the current frame.
+    TextBatch batch;
+
+    /// Shadow and outline of the typed text, nullptr for none.
+    const TextEffect *effect = nullptr;
+
+    /// Next marker of layout.markers to be applied.
+    size_t next_marker = 0;
+
+    /// Speed multiplier set by the last speed marker.
+    float speed = 1.0f;
+
+    /// Reveal every remaining glyph on the next draw.
+    bool skipping = false;
+
+    /// Indicates the current char index.
+    int type_counter;
+
+    /// Indicates the current horizontal position of the char.
+    int current_x;
+
+    /// Needs to be updated every frame (by adding delta time).
+    float timer;
+
+    /// Duration in seconds of a character typing.
+    float duration;
+
+    TypeStats(int _tc, int _cx, float _t, float _d)
+    {
+        type_counter = _tc;
+        current_x = _cx;
+        timer = _t;
+        duration = _d;
+    }
+
+    /// Show the rest of the text on the next draw, ignoring pauses.
+    void skip()
+    {
+        skipping = true;
+    }
+
+    /// Type a new text from the start, even if it sits at the same address as the last one.
+    void restart()
+    {
+        type_counter = 0;
+        timer = 0;
+        speed = 1.0f;
+        skipping = false;
+        layout.invalidate();
+    }
+
+    /// Check if every glyph of the text was typed.
+    bool finished() const
+    {
+        return layout.valid && type_counter >= (int)layout.glyphs.size();
+    }
+};
+
+/**
+ * Hash a text with 32 bit FNV-1a.
+ * @param text text to be hashed.
+ * @returns hash
+ */
+uint32_t text_hash(std::string_view text);
+
+/// Storage used by a TextCache for its entries.
+enum TextCacheMode
+{
+    /// Keep a prebuilt vertex batch per entry, costs RAM.
+    TEXT_CACHE_VERTICES,
+
+    /// Keep a tight render target texture per entry, costs VRAM.
+    TEXT_CACHE_TEXTURES
+};
+
+/**
+ * @brief Least recently used cache of drawn texts.
+ *
+ * Each entry is keyed by the text and every setting that changes its look,
+ * so drawing an unchanged label costs a lookup plus a single draw call.
+ * Entries are evicted, least recently used first, once the budget is exceeded.
+ */
+struct TextCache
+{
+    struct Entry
+    {
+        uint32_t key = 0;
+        std::string text;
+        const FontAtlas *atlas = nullptr;
+        int size = 0;
+        int h_offset = 0;
+        int v_offset = 0;
+
+        /// Wrap width for multiline texts, -1 for single line texts.
+        int max_width = -1;
+
+        SDL_Color color = {255, 255, 255, 255};
+
+        /// Quads built at origin_x/origin_y (TEXT_CACHE_VERTICES).
+        TextBatch batch;
+        int origin_x = 0;
+        int origin_y = 0;
+
+        /// Atlas page_generation when the quads were built, older quads may use evicted pages.
+        uint32_t generation = 0;
+
+        /// Text drawn relative to the text origin (TEXT_CACHE_TEXTURES).
+        SDL_Texture *texture = nullptr;
+        SDL_Rect area = {0, 0, 0, 0};
+
+        size_t bytes = 0;
+        uint32_t last_used = 0;
+    };
+
+    TextCacheMode mode;
+
+    /// Max amount of RAM (vertices) or VRAM (textures) used by the entries, in bytes.
+    size_t budget;
+
+    /// Amount of memory currently used by the entries, in bytes.
+    size_t used = 0;
+
+    uint32_t tick = 0;
+    std::vector<Entry> entries;
+
+    /**
+     * Initialize a TextCache
+     * @param _mode storage used for the entries.
+     * @param _budget max amount of memory used by the entries, in bytes.
+     */
+    TextCache(TextCacheMode _mode = TEXT_CACHE_VERTICES, size_t _budget = 64 * 1024)
+    {
+        mode = _mode;
+        budget = _budget;
+    }
+
+    ~TextCache()
+    {
+        clear();
+    }
+
+    /**
+     * Find the entry of a text.
+     * @returns entry pointer, or nullptr if the text isn't cached.
+     */
+    Entry *find(const uint32_t key,
+                std::string_view text,
+                const FontAtlas *atlas,
+                const int size,
+                const int h_offset,
+                const int v_offset,
+                const int max_width,
+                const SDL_Color color)
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            Entry &e = entries[i];
+            if (e.key == key &&
+                e.atlas == atlas &&
+                e.size == size &&
+                e.h_offset == h_offset &&
+                e.v_offset == v_offset &&
+                e.max_width == max_width &&
+                e.color.r == color.r && e.color.g == color.g && e.color.b == color.b &&
+                e.text == text)
+            {
+                if (mode == TEXT_CACHE_VERTICES && e.generation != atlas->page_generation)
+                {
+                    evict(i);
+                    return nullptr;
+                }
+                e.last_used = ++tick;
+                return &e;
+            }
+        }
+        return nullptr;
+    }
+
+    /// Evict least recently used entries until the cache fits its budget, always keeping the newest.
+    void trim()
+    {
+        while (used > budget && entries.size() > 1)
+        {
+            size_t oldest = 0;
+            for (size_t i = 1; i < entries.size(); i++)
+            {
+                if (entries[i].last_used < entries[oldest].last_used)
+                    oldest = i;
+            }
+            evict(oldest);
+        }
+    }
+
+    /// Remove an entry, releasing its memory.
+    void evict(const size_t i)
+    {
+        used -= entries[i].bytes;
+        SIMPLE_TEXT_COUNT(texture_destroys, entries[i].texture != nullptr);
+        SDL_DestroyTexture(entries[i].texture);
+        if (i + 1 != entries.size())
+            entries[i] = std::move(entries.back());
+        entries.pop_back();
+    }
+
+    /// Remove every entry.
+    void clear()
+    {
+        while (!entries.empty())
+            evict(entries.size() - 1);
+    }
+};
+
+/**
+ * @brief Fixed capacity text for values that change every frame (scores, timers, FPS).
+ *
+ * Keeps one quad per character slot and, on every update, only rewrites the quads
+ * of the characters that changed. Numbers are formatted straight into glyph indices.
+ */
+struct DynamicText
+{
+    const FontAtlas *atlas;
+    int x;
+    int y;
+    int size;
+    int h_offset;
+    SDL_Color color;
+
+    /// Max amount of characters.
+    int capacity;
+
+    /// Amount of characters currently shown.
+    int length = 0;
+
+    /// Glyph index of every slot, -1 for spaces and unused slots.
+    std::vector<int> glyphs;
+
+    /// Pen position of every slot, relative to x.
+    std::vector<int> pens;
+
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+
+    /// Glyph indices used by the number formatters.
+    int digit_glyphs[10];
+    int minus_glyph;
+    int dot_glyph;
+
+    /// Amount of quads rewritten by the last update.
+    int last_changes = 0;
+
+    /**
+     * Initialize the DynamicText
+     * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+     * @param _capacity max amount of characters.
+     * @param _x position X inside the current renderer context.
+     * @param _y position Y inside the current renderer context.
+     * @param _size size of the font when drawing.
+     * @param _h_offset horizontal offset between characters in percentage.
+     * @param _color Color of the text in RGB format.
+     */
+    DynamicText(const FontAtlas &font_atlas,
+                const int _capacity,
+                const int _x,
+                const int _y,
+                const int _size,
+                const int _h_offset = 57,
+                SDL_Color _color = {255, 255, 255})
+    {
+        atlas = &font_atlas;
+        capacity = _capacity;
+        x = _x;
+        y = _y;
+        size = _size;
+        h_offset = _h_offset;
+        color = _color;
+        color.a = 255;
+
+        glyphs.assign(capacity, -1);
+        pens.assign(capacity, 0);
+        vertices.assign(capacity * 4, SDL_Vertex());
+        indices.resize(capacity * 6);
+        for (int i = 0; i < capacity; i++)
+        {
+            indices[i * 6 + 0] = i * 4;
+            indices[i * 6 + 1] = i * 4 + 1;
+            indices[i * 6 + 2] = i * 4 + 2;
+            indices[i * 6 + 3] = i * 4;
+            indices[i * 6 + 4] = i * 4 + 2;
+            indices[i * 6 + 5] = i * 4 + 3;
+        }
+        for (int i = 0; i < 10; i++)
+            digit_glyphs[i] = font_atlas.glyph_index('0' + i);
+        minus_glyph = font_atlas.glyph_index('-');
+        dot_glyph = font_atlas.glyph_index('.');
+    }
+
+    /**
+     * Show a sequence of glyph indices, rewriting only the quads that changed.
+     * @param new_glyphs glyph indices, -1 for a space.
+     * @param count amount of glyphs, clamped to the capacity.
+     */
+    void set_glyphs(const int *new_glyphs, int count)
+    {
+        if (count > capacity)
+            count = capacity;
+        last_changes = 0;
+        int pen = 0;
+        int previous = -1;
+        for (int i = 0; i < capacity; i++)
+        {
+            const int index = i < count ? new_glyphs[i] : -1;
+            if (i < count)
+                pen += atlas->kerning(previous, index, size);
+            if (index != glyphs[i] || (index != -1 && pen != pens[i]))
+            {
+                glyphs[i] = index;
+                pens[i] = pen;
+                write_quad(i);
+                last_changes++;
+            }
+            if (i < count)
+            {
+                pen += atlas->glyph_advance(index, size, h_offset);
+                previous = index;
+            }
+        }
+        length = count;
+    }
+
+    /**
+     * Show a text, characters missing from the atlas are skipped.
+     * @param text UTF-8 text.
+     */
+    void set_text(std::string_view text)
+    {
+        int buffer[64];
+        int count = 0;
+        int *out = buffer;
+        const size_t mark = text_frame_arena.mark();
+        if (text.size() > 64)
+        {
+            out = (int *)text_frame_arena.allocate(text.size() * sizeof(int));
+            if (out == nullptr)
+                return;
+        }
+        for (auto c : Utf8Text(text))
+        {
+            const int index = c == ' ' ? -1 : atlas->glyph_index(c);
+            if (c != ' ' && index == -1)
+                continue;
+            out[count++] = index;
+        }
+        set_glyphs(out, count);
+        text_frame_arena.release(mark);
+    }
+
+    /**
+     * Show an integer.
+     * @param value number to show.
+     * @param min_digits pad with zeros up to this amount of digits.
+     */
+    void set_int(const int32_t value, const int min_digits = 0)
+    {
+        int buffer[16];
+        const int count = format_int(value, min_digits, buffer);
+        set_glyphs(buffer, count);
+    }
+
+    /**
+     * Show a number with a fixed amount of decimals, rounded to the nearest.
+     * @param value number to show.
+     * @param decimals amount of digits after the dot, up to 6.
+     */
+    void set_float(const float value, int decimals = 2)
+    {
+        if (!(value == value))
+        {
+            set_text("NaN");
+            return;
+        }
+        if (value > 2147483647.0f || value < -2147483647.0f)
+        {
+            set_text(value > 0 ? "inf" : "-inf");
+            return;
+        }
+        if (decimals < 0)
+            decimals = 0;
+        if (decimals > 6)
+            decimals = 6;
+
+        int64_t scale = 1;
+        for (int i = 0; i < decimals; i++)
+            scale *= 10;
+        const bool negative = value < 0.0f;
+        const int64_t scaled = (int64_t)((negative ? -value : value) * scale + 0.5f);
+        const int64_t whole = scaled / scale;
+        int64_t fraction = scaled % scale;
+
+        int buffer[40];
+        int count = 0;
+        if (negative && scaled != 0)
+            buffer[count++] = minus_glyph;
+        count += format_int((int32_t)(whole > 2147483647 ? 2147483647 : whole), 0, buffer + count);
+        if (decimals > 0)
+        {
+            buffer[count++] = dot_glyph;
+            for (int i = decimals - 1; i >= 0; i--)
+            {
+                buffer[count + i] = digit_glyphs[fraction % 10];
+                fraction /= 10;
+            }
+            count += decimals;
+        }
+        set_glyphs(buffer, count);
+    }
+
+    /**
+     * Write the glyph indices of an integer.
+     * @param value number to format.
+     * @param min_digits pad with zeros up to this amount of digits.
+     * @param out buffer with room for at least 12 + min_digits glyphs.
+     * @returns amount of glyphs written
+     */
+    int format_int(const int32_t value, int min_digits, int *out) const
+    {
+        int64_t v = value;
+        int count = 0;
+        if (v < 0)
+        {
+            out[count++] = minus_glyph;
+            v = -v;
+        }
+        int digits[20];
+        int amount = 0;
+        do
+        {
+            digits[amount++] = (int)(v % 10);
+            v /= 10;
+        } while (v > 0 && amount < 20);
+        if (min_digits > 20)
+            min_digits = 20;
+        while (amount < min_digits)
+            digits[amount++] = 0;
+        while (amount > 0)
+            out[count++] = digit_glyphs[digits[--amount]];
+        return count;
+    }
+
+    /**
+     * Move the text, rewriting every quad.
+     * @param _x position X inside the current renderer context.
+     * @param _y position Y inside the current renderer context.
+     */
+    void move(const int _x, const int _y)
+    {
+        if (_x == x && _y == y)
+            return;
+        x = _x;
+        y = _y;
+        for (int i = 0; i < length; i++)
+            write_quad(i);
+    }
+
+    /// Rewrite the quad of a slot from its glyph and pen position.
+    void write_quad(const int i)
+    {
+        SDL_Vertex *v = &vertices[i * 4];
+        const int index = glyphs[i];
+        if (index == -1)
+        {
+            for (int k = 0; k < 4; k++)
+                v[k] = {{0.0f, 0.0f}, color, {0.0f, 0.0f}};
+            return;
+        }
+        const SDL_Rect destiny = atlas->glyph_destiny(index, x + pens[i], y, size);
+        const SDL_FRect &uv = atlas->glyph_uvs[index];
+        const float x0 = (float)destiny.x;
+        const float y0 = (float)destiny.y;
+        const float x1 = (float)(destiny.x + destiny.w);
+        const float y1 = (float)(destiny.y + destiny.h);
+        v[0] = {{x0, y0}, color, {uv.x, uv.y}};
+        v[1] = {{x1, y0}, color, {uv.x + uv.w, uv.y}};
+        v[2] = {{x1, y1}, color, {uv.x + uv.w, uv.y + uv.h}};
+        v[3] = {{x0, y1}, color, {uv.x, uv.y + uv.h}};
+    }
+
+    /**
+     * Draw the text with a single SDL_RenderGeometry call per atlas page.
+     * @param renderer SDL_Renderer pointer to the current renderer.
+     */
+    void draw(SDL_Renderer *renderer) const
+    {
+        SIMPLE_TEXT_TIME_DRAW;
+        int start = 0;
+        SDL_Texture *texture = nullptr;
+        for (int i = 0; i < length; i++)
+        {
+            if (glyphs[i] == -1)
+                continue;
+            SDL_Texture *current = atlas->glyph_texture(glyphs[i]);
+            if (current != texture)
+            {
+                SIMPLE_TEXT_COUNT(geometry_draws, texture != nullptr);
+                SIMPLE_TEXT_COUNT(glyphs_drawn, texture != nullptr ? i - start : 0);
+                if (texture != nullptr)
+                    SDL_RenderGeometry(renderer, texture, vertices.data(), length * 4, indices.data() + start * 6, (i - start) * 6);
+                start = i;
+                texture = current;
+            }
+        }
+        SIMPLE_TEXT_COUNT(geometry_draws, texture != nullptr);
+        SIMPLE_TEXT_COUNT(glyphs_drawn, texture != nullptr ? length - start : 0);
+        if (texture != nullptr)
+            SDL_RenderGeometry(renderer, texture, vertices.data(), length * 4, indices.data() + start * 6, (length - start) * 6);
+    }
+};
+
+/**
+ * Get the index of an given character.
+ * @param input_string reference to the original text.
+ * @returns text without newline characters
+ */
+int get_char_index(uint32_t character, const char *atlas);
+
+/**
+ * Remove all newline characters from a string.
+ * @param input_string reference to the original text.
+ * @returns text without newline characters
+ */
+std::string remove_new_lines(const std::string &input_string);
+
+/**
+ * Split a text into a vector of strings using newline character as separator.
+ * @param input_string reference to the original text.
+ * @returns splitted text
+ */
+std::vector<std::string> split_string_by_newline(const std::string &input_string);
+
+/**
+ * Split a text into a vector of strings when the horizontal draw size is too long.
+ * @param text reference to the original text.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param max_length max horizontal draw size per line.
+ * @returns splitted text
+ */
+std::vector<std::string> split_text_by_size(const std::string &text, const int size, const int h_offset, const int max_length);
+
+/**
+ * Wrap a text into lines, breaking at newlines and at spaces when the horizontal
+ * draw size is too long. Runs in a single pass over the text.
+ * @param text UTF-8 text, the spans point into it.
+ * @param font_atlas FontAtlas pointer used to measure glyphs, nullptr measures every character as a fixed advance.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param max_length max horizontal draw size per line.
+ * @param lines vector that will be cleared and receive one span per line.
+ * @returns amount of lines
+ */
+size_t wrap_text(std::string_view text,
+                 const FontAtlas *font_atlas,
+                 const int size,
+                 const int h_offset,
+                 const int max_length,
+                 std::vector<LineSpan> &lines);
+
+/**
+ * Same as wrap_text, but hands each line to a callback instead of storing it,
+ * so a text can be wrapped and drawn without any memory for the lines.
+ * @param emit callable receiving a const LineSpan & per line, in order.
+ * @returns amount of lines
+ */
+template <typename Emit>
+size_t wrap_text_each(std::string_view text,
+                      const FontAtlas *font_atlas,
+                      const int size,
+                      const int h_offset,
+                      const int max_length,
+                      Emit emit);
+
+/**
+ * Split a text into a vector of strings when the horizontal draw size is too long,
+ * measuring each glyph with the atlas metrics.
+ * @param text reference to the original text.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param max_length max horizontal draw size per line.
+ * @returns splitted text
+ */
+std::vector<std::string> split_text_by_size(const std::string &text, const FontAtlas &font_atlas, const int size, const int h_offset, const int max_length);
+
+/**
+ * Get the horizontal draw size of a text line.
+ * @param text UTF-8 text line.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @returns width in pixels
+ */
+int measure_text(std::string_view text, const FontAtlas &font_atlas, const int size, const int h_offset);
+
+/**
+ * Split a text into a vector of strings using newline as separator and breaking the
+ * line when the horizontal draw sie is too long.
+ * @param text reference to the original text.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param max_length max horizontal draw size per line.
+ * @returns splitted text
+ */
+std::vector<std::string> get_all_lines(const std::string &text, const int size, const int h_offset, const int max_length);
+
+/**
+ * Split a text into a vector of strings using newline as separator and breaking the
+ * line when the horizontal draw size, measured with the atlas metrics, is too long.
+ * @param text reference to the original text.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param max_length max horizontal draw size per line.
+ * @returns splitted text
+ */
+std::vector<std::string> get_all_lines(const std::string &text, const FontAtlas &font_atlas, const int size, const int h_offset, const int max_length);
+
+/**
+ * Wrap and position a text, storing the result into a TextLayout.
+ * @param layout TextLayout reference that will receive the result.
+ * @param text reference to the original text.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param v_offset vertical offset between characters in percentage.
+ * @param max_length max horizontal draw size per line.
+ */
+void build_text_layout(TextLayout &layout,
+                       const std::string &text,
+                       const FontAtlas &font_atlas,
+                       const int size,
+                       const int h_offset,
+                       const int v_offset,
+                       const int max_length);
+
+/**
+ * Draw a range of glyphs of a TextLayout into the current render target.
+ * @param layout TextLayout reference to be drawed.
+ * @param font_atlas FontAtlas reference the layout was built with.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X of the layout origin.
+ * @param y position Y of the layout origin.
+ * @param first index of the first glyph to draw.
+ * @param count amount of glyphs to draw, clamped to the layout size.
+ */
+void draw_text_layout(const TextLayout &layout,
+                      const FontAtlas &font_atlas,
+                      SDL_Renderer *renderer,
+                      const int x,
+                      const int y,
+                      const size_t first = 0,
+                      size_t count = SIZE_MAX);
+
+/**
+ * Turn glyph quads into SDL_Vertex quads, four glyphs at a time with the VFPU on
+ * PSP and SSE or NEON on desktop. Define SIMPLE_TEXT_NO_SIMD to force the scalar
+ * version, every version gives the same vertices.
+ * @param boxes destiny box of every quad, relative to the origin.
+ * @param uvs texture coordinates of every quad.
+ * @param count amount of quads.
+ * @param origin_x position X added to every box.
+ * @param origin_y position Y added to every box.
+ * @param color color of every vertex.
+ * @param out array that receives 4 * count vertices, in the TextBatch::add_quad order.
+ */
+void build_quad_vertices(const GlyphQuad *boxes,
+                         const GlyphQuad *uvs,
+                         const size_t count,
+                         const float origin_x,
+                         const float origin_y,
+                         const SDL_Color color,
+                         SDL_Vertex *out);
+
+/**
+ * Queue a range of glyphs of a TextLayout into a TextBatch, see build_quad_vertices.
+ * @param layout TextLayout reference to be drawed.
+ * @param font_atlas FontAtlas reference the layout was built with.
+ * @param batch TextBatch reference that will receive the quads.
+ * @param x position X of the layout origin.
+ * @param y position Y of the layout origin.
+ * @param first index of the first glyph to draw.
+ * @param count amount of glyphs to draw, clamped to the layout size.
+ * @param color Color of the text in RGB format.
+ * @param effect shadow and outline queued with the glyphs, nullptr for none.
+ */
+void draw_text_layout_batched(const TextLayout &layout,
+                              const FontAtlas &font_atlas,
+                              TextBatch &batch,
+                              const int x,
+                              const int y,
+                              const size_t first = 0,
+                              size_t count = SIZE_MAX,
+                              SDL_Color color = {255, 255, 255},
+                              const TextEffect *effect = nullptr);
+
+/**
+ * @brief Lock free queue between one producer and one consumer thread.
+ *
+ * Only atomic loads and stores are used, the PSP CPU has no LL/SC for
+ * read-modify-write atomics.
+ */
+template <typename T, uint32_t N>
+struct SpscQueue
+{
+    static_assert((N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+    T items[N];
+
+    /// Next item to pop, written only by the consumer.
+    std::atomic<uint32_t> head{0};
+
+    /// Next free slot, written only by the producer.
+    std::atomic<uint32_t> tail{0};
+
+    /// Producer side, returns false if the queue is full.
+    bool push(const T &item)
+    {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N)
+            return false;
+        items[t & (N - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side, returns false if the queue is empty.
+    bool pop(T &item)
+    {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        item = items[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/// Work a TextWorker can do.
+enum TextJobKind
+{
+    /// Build a TextLayout.
+    TEXT_JOB_LAYOUT,
+
+    /// Decode an image file into job.surface.
+    TEXT_JOB_SURFACE,
+
+    /// Decode a FontAtlas page, uploaded by TextWorker::poll.
+    TEXT_JOB_PAGE
+};
+
+/**
+ * @brief Job sent to a TextWorker and handed back when done.
+ *
+ * Everything pointed by a job must stay alive and untouched until it comes back from poll.
+ */
+struct TextJob
+{
+    TextJobKind kind;
+    TextLayout *layout;
+    const std::string *text;
+    const FontAtlas *atlas;
+    int size;
+    int h_offset;
+    int v_offset;
+    int max_width;
+    const char *filename;
+    int page;
+
+    /// Decoded image of a TEXT_JOB_SURFACE job, owned by the caller after poll.
+    SDL_Surface *surface;
+
+    /// Free pointer for the caller.
+    void *user;
+};
+
+/**
+ * @brief Background thread that builds layouts and decodes images.
+ *
+ * Runs on sceKernelCreateThread on PSP and SDL_CreateThread elsewhere, with a
+ * lower priority than the main thread. On the single core PSP it works while
+ * the main thread waits for vblank. Results come back through poll(), called
+ * from the render thread, which is the only place textures are created.
+ * Jobs run on submit when the thread could not be started.
+ * The worker thread is left out of the stats and heap allocation counters, so its
+ * work never shows in a frame and never trips the text_frame_end allocation assert.
+ */
+struct TextWorker
+{
+    SpscQueue<TextJob, 32> requests;
+    SpscQueue<TextJob, 32> results;
+    std::atomic<bool> running{false};
+
+    /// Jobs submitted and not polled yet.
+    uint32_t in_flight = 0;
+
+#ifdef __psp__
+    SceUID thread = -1;
+    SceUID semaphore = -1;
+#else
+    SDL_Thread *thread = nullptr;
+    SDL_sem *semaphore = nullptr;
+#endif
+
+    TextWorker() = default;
+    TextWorker(const TextWorker &) = delete;
+    TextWorker &operator=(const TextWorker &) = delete;
+
+    ~TextWorker()
+    {
+        stop();
+    }
+
+    /**
+     * Start the thread.
+     * @returns false if it could not be created, jobs will then run on submit
+     */
+    bool start()
+    {
+        if (running.load())
+            return true;
+        running.store(true);
+#ifdef __psp__
+        semaphore = sceKernelCreateSema("text_worker", 0, 0, 0x7FFFFFFF, nullptr);
+        thread = semaphore < 0 ? -1 : sceKernelCreateThread("text_worker", &TextWorker::entry, 0x30, 0x10000, PSP_THREAD_ATTR_USER, nullptr);
+        TextWorker *self = this;
+        if (thread < 0 || sceKernelStartThread(thread, sizeof(self), &self) < 0)
+        {
+            stop();
+            return false;
+        }
+#else
+        semaphore = SDL_CreateSemaphore(0);
+        thread = semaphore ? SDL_CreateThread(&TextWorker::entry, "text_worker", this) : nullptr;
+        if (thread == nullptr)
+        {
+            stop();
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    /// Stop the thread, dropping the jobs it didn't start.
+    void stop()
+    {
+        running.store(false);
+#ifdef __psp__
+        if (thread >= 0)
+        {
+            sceKernelSignalSema(semaphore, 1);
+            sceKernelWaitThreadEnd(thread, nullptr);
+            sceKernelDeleteThread(thread);
+            thread = -1;
+        }
+        if (semaphore >= 0)
+            sceKernelDeleteSema(semaphore);
+        semaphore = -1;
+#else
+        if (thread)
+        {
+            SDL_SemPost(semaphore);
+            SDL_WaitThread(thread, nullptr);
+            thread = nullptr;
+        }
+        if (semaphore)
+            SDL_DestroySemaphore(semaphore);
+        semaphore = nullptr;
+#endif
+        TextJob job;
+        while (requests.pop(job))
+        {
+        }
+        while (results.pop(job))
+            SDL_FreeSurface(job.surface);
+        in_flight = 0;
+    }
+
+    /**
+     * Send a job to the thread.
+     * @returns false if the queue is full
+     */
+    bool submit(TextJob job)
+    {
+        if (!running.load())
+        {
+            run_job(job);
+            if (!results.push(job))
+            {
+                SDL_FreeSurface(job.surface);
+                return false;
+            }
+            in_flight++;
+            return true;
+        }
+        if (!requests.push(job))
+            return false;
+        in_flight++;
+#ifdef __psp__
+        sceKernelSignalSema(semaphore, 1);
+#else
+        SDL_SemPost(semaphore);
+#endif
+        return true;
+    }
+
+    /**
+     * Build a TextLayout in the background, see build_text_layout.
+     * The layout is invalid until the job comes back from poll.
+     */
+    bool prepare_layout(TextLayout &layout, const std::string &text, const FontAtlas &font_atlas,
+                        const int size, const int h_offset, const int v_offset, const int max_width, void *user = nullptr)
+    {
+        layout.invalidate();
+        return submit({TEXT_JOB_LAYOUT, &layout, &text, &font_atlas, size, h_offset, v_offset, max_width, nullptr, 0, nullptr, user});
+    }
+
+    /// Decode an image file in the background, the surface comes back from poll.
+    bool load_surface(const char *filename, void *user = nullptr)
+    {
+        return submit({TEXT_JOB_SURFACE, nullptr, nullptr, nullptr, 0, 0, 0, 0, filename, 0, nullptr, user});
+    }
+
+    /// Decode a page of a paged FontAtlas in the background, uploaded by poll.
+    bool load_page(const FontAtlas &font_atlas, const int page)
+    {
+        if (page < 0 || page >= (int)font_atlas.pages.size() || font_atlas.pages[page].texture)
+            return false;
+        return submit({TEXT_JOB_PAGE, nullptr, nullptr, &font_atlas, 0, 0, 0, 0, font_atlas.pages[page].filename.c_str(), page, nullptr, nullptr});
+    }
+
+    /**
+     * Take a finished job, call it from the render thread.
+     * Atlas pages are uploaded here, their surface is already freed.
+     * @returns false if no job finished
+     */
+    bool poll(TextJob &done)
+    {
+        if (!results.pop(done))
+            return false;
+        in_flight--;
+        if (done.kind == TEXT_JOB_PAGE)
+        {
+            TextBudgetTimer budget;
+            done.atlas->attach_page(done.page, done.surface);
+            done.surface = nullptr;
+        }
+        return true;
+    }
+
+    static void run_job(TextJob &job)
+    {
+        if (job.kind == TEXT_JOB_LAYOUT)
+            build_text_layout(*job.layout, *job.text, *job.atlas, job.size, job.h_offset, job.v_offset, job.max_width);
+        else
+            job.surface = IMG_Load(job.filename);
+    }
+
+    void run()
+    {
+#if defined(SIMPLE_TEXT_STATS) || defined(SIMPLE_TEXT_COUNT_ALLOCS)
+        text_stats_disabled = true;
+#endif
+        while (true)
+        {
+#ifdef __psp__
+            sceKernelWaitSema(semaphore, 1, nullptr);
+#else
+            SDL_SemWait(semaphore);
+#endif
+            if (!running.load())
+                return;
+            TextJob job;
+            if (!requests.pop(job))
+                continue;
+            run_job(job);
+            while (!results.push(job))
+            {
+                if (!running.load())
+                {
+                    SDL_FreeSurface(job.surface);
+                    return;
+                }
+#ifdef __psp__
+                sceKernelDelayThread(1000);
+#else
+                SDL_Delay(1);
+#endif
+            }
+        }
+    }
+
+#ifdef __psp__
+    static int entry(SceSize, void *argp)
+    {
+        (*(TextWorker **)argp)->run();
+        return 0;
+    }
+#else
+    static int entry(void *data)
+    {
+        ((TextWorker *)data)->run();
+        return 0;
+    }
+#endif
+};
+
+/**
+ * @brief Page of a TextStream, with its text and layout.
+ */
+struct TextPage
+{
+    /// Text of the page, paragraphs separated by newlines.
+    std::string text;
+
+    /// Layout of the text, built when the page is read.
+    TextLayout layout;
+
+    /// Index of the page since the stream was opened.
+    uint32_t number = 0;
+};
+
+/**
+ * @brief Script file read in chunks and split into pages that fit a text box.
+ *
+ * Only SIMPLE_TEXT_STREAM_CHUNK bytes of the file and two pages, the visible
+ * one and the next, are kept in memory, so long scripts cost the same as short
+ * ones. A page ends when the box is full or at an empty line; paragraphs that
+ * don't fit continue on the next page. Turning a page lays out only the new
+ * page ahead.
+ */
+struct TextStream
+{
+    SDL_RWops *file = nullptr;
+    const FontAtlas *atlas = nullptr;
+    int width = 0;
+    int max_lines = 1;
+    int size = 16;
+    int h_offset = 57;
+    int v_offset = 70;
+
+    /// Unread bytes of the file are chunk[chunk_start, chunk_end).
+    std::vector<char> chunk;
+    size_t chunk_start = 0;
+    size_t chunk_end = 0;
+    bool end_of_file = true;
+
+    /// Visible page and the page ahead.
+    TextPage pages[2];
+    int current = 0;
+    uint32_t page_count = 0;
+
+    /// Scratch lines of the paragraph being paginated.
+    std::vector<LineSpan> spans;
+
+    TextStream() = default;
+    TextStream(const TextStream &) = delete;
+    TextStream &operator=(const TextStream &) = delete;
+
+    ~TextStream()
+    {
+        close();
+    }
+
+    /**
+     * Open a script file and read its first two pages.
+     * @param filename path of the UTF-8 script.
+     * @param font_atlas FontAtlas reference used to measure and lay out the pages.
+     * @param box size of the text box, only w and h are used.
+     * @param _size size of the font when drawing.
+     * @param _h_offset horizontal offset between characters in percentage.
+     * @param _v_offset vertical offset between characters in percentage.
+     * @returns false if the file could not be opened
+     */
+    bool open(const char *filename, const FontAtlas &font_atlas, const SDL_Rect &box, const int _size, const int _h_offset = 57, const int _v_offset = 70)
+    {
+        return open(SDL_RWFromFile(filename, "rb"), font_atlas, box, _size, _h_offset, _v_offset);
+    }
+
+    /**
+     * Same as open, reading from a SDL_RWops that is closed with the stream.
+     */
+    bool open(SDL_RWops *source, const FontAtlas &font_atlas, const SDL_Rect &box, const int _size, const int _h_offset = 57, const int _v_offset = 70)
+    {
+        close();
+        if (source == nullptr)
+            return false;
+        file = source;
+        atlas = &font_atlas;
+        width = box.w;
+        size = _size;
+        h_offset = _h_offset;
+        v_offset = _v_offset;
+        const int line_height = size * v_offset / 100 > 0 ? size * v_offset / 100 : 1;
+        max_lines = box.h > size ? (box.h - size) / line_height + 1 : 1;
+        chunk.resize(SIMPLE_TEXT_STREAM_CHUNK);
+        chunk_start = 0;
+        chunk_end = 0;
+        end_of_file = false;
+        page_count = 0;
+        current = 0;
+        read_page(pages[0]);
+        read_page(pages[1]);
+        return true;
+    }
+
+    /// Close the file, keeping the memory for the next open.
+    void close()
+    {
+        if (file)
+            SDL_RWclose(file);
+        file = nullptr;
+        end_of_file = true;
+        chunk_start = 0;
+        chunk_end = 0;
+        pages[0].text.clear();
+        pages[1].text.clear();
+        pages[0].layout.invalidate();
+        pages[1].layout.invalidate();
+    }
+
+    /// Visible page, nullptr when the script is over.
+    const TextPage *page() const
+    {
+        return pages[current].text.empty() ? nullptr : &pages[current];
+    }
+
+    /**
+     * Drop the visible page, show the page ahead and read the one after it.
+     * @returns false when there are no pages left
+     */
+    bool next()
+    {
+        if (pages[current].text.empty())
+            return false;
+        read_page(pages[current]);
+        current ^= 1;
+        return !pages[current].text.empty();
+    }
+
+    /**
+     * Find the next line of the chunk, reading more of the file when needed.
+     * Lines longer than the chunk are cut at a character boundary.
+     * @returns false at the end of the file
+     */
+    bool peek_line(std::string_view &line, size_t &consumed)
+    {
+        while (true)
+        {
+            const char *start = chunk.data() + chunk_start;
+            const size_t available = chunk_end - chunk_start;
+            const char *newline = (const char *)memchr(start, '\n', available);
+            if (newline)
+            {
+                line = std::string_view(start, newline - start);
+                consumed = line.size() + 1;
+                return true;
+            }
+            if (end_of_file || available == chunk.size())
+            {
+                if (available == 0)
+                    return false;
+                size_t length = available;
+                if (!end_of_file)
+                {
+                    // Cut after the last space, or before the last character that could be incomplete.
+                    const std::string_view full(start, available);
+                    const size_t space = full.rfind(' ');
+                    if (space != std::string_view::npos)
+                    {
+                        length = space + 1;
+                    }
+                    else
+                    {
+                        while (length > 1 && ((unsigned char)start[length - 1] & 0xC0) == 0x80)
+                            length--;
+                        length = length > 1 ? length - 1 : available;
+                    }
+                }
+                line = std::string_view(start, length);
+                consumed = length;
+                return true;
+            }
+            // Move the unread bytes to the front and fill the rest of the chunk.
+            memmove(chunk.data(), start, available);
+            chunk_start = 0;
+            chunk_end = available;
+            const size_t read = file ? SDL_RWread(file, chunk.data() + chunk_end, 1, chunk.size() - chunk_end) : 0;
+            chunk_end += read;
+            if (read == 0)
+                end_of_file = true;
+        }
+    }
+
+    /// Fill a page with the next lines of the script and lay it out.
+    void read_page(TextPage &p)
+    {
+        p.text.clear();
+        int lines = 0;
+        std::string_view line;
+        size_t consumed = 0;
+        while (lines < max_lines && peek_line(line, consumed))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (line.find_first_not_of(" \t") == std::string_view::npos)
+            {
+                // Empty lines end a page, or are skipped at its start.
+                if (!p.text.empty())
+                {
+                    chunk_start += consumed;
+                    break;
+                }
+                chunk_start += consumed;
+                continue;
+            }
+            const int count = (int)wrap_text(line, atlas, size, h_offset, width, spans);
+            if (lines + count > max_lines)
+            {
+                // Only the first lines of the paragraph fit, the rest starts the next page.
+                const LineSpan &last = spans[max_lines - lines - 1];
+                size_t taken = last.offset + last.length;
+                if (!p.text.empty())
+                    p.text.push_back('\n');
+                p.text.append(line.data(), taken);
+                while (taken < line.size() && (line[taken] == ' ' || line[taken] == '\t'))
+                    taken++;
+                chunk_start += taken;
+                lines = max_lines;
+                break;
+            }
+            if (!p.text.empty())
+                p.text.push_back('\n');
+            p.text.append(line.data(), line.size());
+            chunk_start += consumed;
+            lines += count;
+        }
+        p.number = page_count++;
+        if (p.text.empty())
+            p.layout.invalidate();
+        else
+            build_text_layout(p.layout, p.text, *atlas, size, h_offset, v_offset, width);
+    }
+};
+
+/**
+ * Get the line of a splitted text by a current char index.
+ *
+ * @param lines splitted text, stored as a vector of strings.
+ * @param current_char index of the current char.
+ * @returns index of the current line.
+ */
+int get_current_line(const std::vector<std::string> &lines, const int current_char);
+
+/**
+ * Draw a text line into a single texture (if provided) or into the renderer.
+ *
+ * @param text string to be drawed.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X inside the current renderer context.
+ * @param y position Y inside the current renderer context.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param target CombineTexture pointer to the texture that will store the text.
+ * @param color Color of the text in RGB format.
+ */
+void draw_text(std::string_view text,
+               const FontAtlas &font_atlas,
+               SDL_Renderer *renderer,
+               const int x,
+               const int y,
+               const int size,
+               const int h_offset = 57,
+               CombinedTexture *target = nullptr,
+               SDL_Color color = {255, 255, 255});
+
+/**
+ * Draw a text line into a single texture (if provided) or into the renderer.
+ *
+ * @param utf8_text text as uint32_t utf8 char vector.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X inside the current renderer context.
+ * @param y position Y inside the current renderer context.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param target CombineTexture pointer to the texture that will store the text.
+ * @param color Color of the text in RGB format.
+ */
+void draw_utf8_text(const std::vector<uint32_t> &utf8_text,
+                    const FontAtlas &font_atlas,
+                    SDL_Renderer *renderer,
+                    const int x,
+                    const int y,
+                    const int size,
+                    const int h_offset,
+                    CombinedTexture *target,
+                    SDL_Color color = {255, 255, 255});
+
+/**
+ * Draw a text line into a single texture (if provided) or into the renderer.
+ *
+ * @param utf8_text pointer to the decoded characters.
+ * @param count amount of characters to draw.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X inside the current renderer context.
+ * @param y position Y inside the current renderer context.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param target CombineTexture pointer to the texture that will store the text.
+ * @param color Color of the text in RGB format.
+ */
+void draw_utf8_text(const uint32_t *utf8_text,
+                    const size_t count,
+                    const FontAtlas &font_atlas,
+                    SDL_Renderer *renderer,
+                    const int x,
+                    const int y,
+                    const int size,
+                    const int h_offset,
+                    CombinedTexture *target,
+                    SDL_Color color = {255, 255, 255});
+
+/**
+ * Split the markup out of a text. Supported tags are {c:RRGGBB} ... {/c} for
+ * color, {z:N} ... {/z} for size, {f:N} ... {/f} for the atlas, {s:x} for
+ * typewriter speed and {p:x} or {w:x} for a typewriter pause.
+ * Braces that don't form a tag are kept as text.
+ * @param text text with markup.
+ * @param plain string that receives the text without markup.
+ * @param runs vector that receives the style runs, with their offset inside plain.
+ * @param markers vector that receives the typewriter markers, with their offset inside plain.
+ * @param color style of the text outside of color tags.
+ * @param size size of the text outside of size tags.
+ */
+void parse_text_markup(std::string_view text,
+                       std::string &plain,
+                       std::vector<TextRun> &runs,
+                       std::vector<TypeMarker> &markers,
+                       const SDL_Color color,
+                       const int size);
+
+/**
+ * Wrap and position a text with markup, see parse_text_markup. Lines are as tall
+ * as their biggest glyphs, and glyphs sit on the bottom of the line.
+ * @param layout TextLayout reference that will receive the result.
+ * @param markup text with markup.
+ * @param atlases list of the atlases selected by {f:N}, {f:0} is the default.
+ * @param atlas_count amount of atlases in the list.
+ * @param size size of the font outside of size tags.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param v_offset vertical offset between lines in percentage.
+ * @param max_length max horizontal draw size per line.
+ * @param color Color of the text outside of color tags.
+ */
+void build_rich_layout(TextLayout &layout,
+                       const std::string &markup,
+                       const FontAtlas *const *atlases,
+                       const int atlas_count,
+                       const int size,
+                       const int h_offset,
+                       const int v_offset,
+                       const int max_length,
+                       const SDL_Color color = {255, 255, 255});
+
+/**
+ * Same as build_rich_layout, with a single atlas.
+ */
+void build_rich_layout(TextLayout &layout,
+                       const std::string &markup,
+                       const FontAtlas &font_atlas,
+                       const int size,
+                       const int h_offset,
+                       const int v_offset,
+                       const int max_length,
+                       const SDL_Color color = {255, 255, 255});
+
+/**
+ * Queue a range of glyphs of a layout built by build_rich_layout into a TextBatch.
+ * Colors go in the vertices, so a whole paragraph is one draw per atlas texture.
+ * @param layout TextLayout reference to be drawed.
+ * @param atlases list of atlases the layout was built with.
+ * @param atlas_count amount of atlases in the list.
+ * @param batch TextBatch reference that will receive the quads.
+ * @param x position X of the layout origin.
+ * @param y position Y of the layout origin.
+ * @param first index of the first glyph to draw.
+ * @param count amount of glyphs to draw, clamped to the layout size.
+ * @param effect shadow and outline queued with the glyphs, nullptr for none.
+ */
+void draw_rich_layout(const TextLayout &layout,
+                      const FontAtlas *const *atlases,
+                      const int atlas_count,
+                      TextBatch &batch,
+                      const int x,
+                      const int y,
+                      const size_t first = 0,
+                      size_t count = SIZE_MAX,
+                      const TextEffect *effect = nullptr);
+
+/**
+ * Same as draw_rich_layout, with a single atlas.
+ */
+void draw_rich_layout(const TextLayout &layout,
+                      const FontAtlas &font_atlas,
+                      TextBatch &batch,
+                      const int x,
+                      const int y,
+                      const size_t first = 0,
+                      size_t count = SIZE_MAX,
+                      const TextEffect *effect = nullptr);
+
+/**
+ * Draw multiline text with typewritter.
+ * The time in stats.timer is spent on as many characters as it covers, so
+ * several can be typed in a single frame. Call stats.skip() to show the rest.
+ *
+ * @param text string to be drawed, can have markup, see parse_text_markup.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param rect SDL_Rect destiny reference.
+ * @param target CombineTexture pointer to the texture that will store the text.
+ * @param stats TypeStats reference to typewritter effect attributes.
+ * @param size size of the font when drawing.
+ * @param callback function that will be called when the text finishes drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param v_offset vertical offset between characters in percentage.
+ */
+void draw_typewriter(const std::string &text,
+                     const FontAtlas &font_atlas,
+                     SDL_Renderer *renderer,
+                     const SDL_Rect &rect,
+                     CombinedTexture *target,
+                     TypeStats &stats,
+                     const int size,
+                     void (*callback)() = nullptr,
+                     const int h_offset = 57,
+                     const int v_offset = 70);
+
+/**
+ * Draw multiline text into a single texture (if provided) or into the renderer.
+ *
+ * @param text string to be drawed.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param rect SDL_Rect destiny reference.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param v_offset vertical offset between characters in percentage.
+ * @param target CombineTexture pointer to the texture that will store the text.
+ */
+void draw_text_multiline(std::string_view text,
+                         const FontAtlas &font_atlas,
+                         SDL_Renderer *renderer,
+                         const SDL_Rect &rect,
+                         const int size,
+                         const int h_offset = 57,
+                         const int v_offset = 70,
+                         CombinedTexture *target = nullptr,
+                         std::vector<std::string> *c_lines = nullptr);
+
+/**
+ * Queue a text line into a TextBatch, to be drawn when the batch is flushed.
+ *
+ * @param text string to be drawed.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param batch TextBatch reference that will receive the glyph quads.
+ * @param x position X inside the current renderer context.
+ * @param y position Y inside the current renderer context.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param color Color of the text in RGB format.
+ * @param effect shadow and outline queued with the text, nullptr for none.
+ */
+void draw_text_batched(std::string_view text,
+                       const FontAtlas &font_atlas,
+                       TextBatch &batch,
+                       const int x,
+                       const int y,
+                       const int size,
+                       const int h_offset = 57,
+                       SDL_Color color = {255, 255, 255},
+                       const TextEffect *effect = nullptr);
+
+/**
+ * Draw a text line into the renderer with a single SDL_RenderGeometry call.
+ *
+ * @param text string to be drawed.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X inside the current renderer context.
+ * @param y position Y inside the current renderer context.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param color Color of the text in RGB format.
+ * @param effect shadow and outline drawn in the same call, nullptr for none.
+ */
+void draw_text_batched(std::string_view text,
+                       const FontAtlas &font_atlas,
+                       SDL_Renderer *renderer,
+                       const int x,
+                       const int y,
+                       const int size,
+                       const int h_offset = 57,
+                       SDL_Color color = {255, 255, 255},
+                       const TextEffect *effect = nullptr);
+
+/**
+ * @brief Scrollable box of wrapped text for logs and backlogs.
+ *
+ * Lines are wrapped once when appended and kept as spans of one string, so
+ * the line under any scroll position is found with a division. The visible
+ * lines and some margin are drawn into a slab texture with one batch, and
+ * scrolling inside the slab only moves the copied region, so a frame costs
+ * the visible lines at most, never the whole text.
+ */
+struct TextView
+{
+    const FontAtlas *atlas;
+    SDL_Rect rect;
+    int size;
+    int h_offset;
+    int line_height;
+    SDL_Color color = {255, 255, 255};
+
+    /// Appended text, the offset of every paragraph in it and the wrapped lines.
+    std::string text;
+    std::vector<uint32_t> paragraphs;
+    std::vector<LineSpan> lines;
+
+    /// rect.w the lines were wrapped at, they are wrapped again when it changes.
+    int wrap_width = 0;
+
+    /// Pixels scrolled from the top.
+    int scroll = 0;
+
+    /// Render target holding slab_count lines from slab_first.
+    SDL_Texture *slab = nullptr;
+    int slab_first = 0;
+    int slab_count = 0;
+    int slab_capacity = 0;
+    bool slab_dirty = true;
+
+    /// The slab could not be created, the lines are drawn straight to the view.
+    bool slab_failed = false;
+
+    TextBatch batch;
+    std::vector<LineSpan> scratch;
+
+    /**
+     * @param font_atlas FontAtlas reference used to wrap and draw the text.
+     * @param _rect region of the screen the view covers.
+     * @param _size size of the font when drawing.
+     * @param _h_offset horizontal offset between characters in percentage.
+     * @param v_offset vertical offset between characters in percentage.
+     */
+    TextView(const FontAtlas &font_atlas, const SDL_Rect &_rect, const int _size, const int _h_offset = 57, const int v_offset = 70)
+    {
+        atlas = &font_atlas;
+        rect = _rect;
+        size = _size;
+        h_offset = _h_offset;
+        line_height = size * v_offset / 100 > 0 ? size * v_offset / 100 : 1;
+        wrap_width = rect.w;
+        slab_capacity = slab_lines();
+    }
+
+    TextView(const TextView &) = delete;
+    TextView &operator=(const TextView &) = delete;
+
+    ~TextView()
+    {
+        SIMPLE_TEXT_COUNT(texture_destroys, slab != nullptr);
+        if (slab)
+            SDL_DestroyTexture(slab);
+    }
+
+    /**
+     * Add a paragraph at the end of the view, only the new text is wrapped.
+     * @param paragraph text to add, newlines start new lines.
+     */
+    void append(std::string_view paragraph)
+    {
+        refit();
+        const uint32_t base = (uint32_t)text.size();
+        text.append(paragraph.data(), paragraph.size());
+        paragraphs.push_back(base);
+        const int first = (int)lines.size();
+        wrap_paragraph(base, paragraph);
+        if (first < slab_first + slab_capacity)
+            slab_dirty = true;
+    }
+
+    /// Remove every line.
+    void clear()
+    {
+        text.clear();
+        paragraphs.clear();
+        lines.clear();
+        scroll = 0;
+        slab_dirty = true;
+    }
+
+    /// Height in pixels of all lines.
+    int content_height() const
+    {
+        return (int)lines.size() * line_height;
+    }
+
+    /// Largest scroll that still fills the view.
+    int max_scroll() const
+    {
+        const int overflow = content_height() - rect.h;
+        return overflow > 0 ? overflow : 0;
+    }
+
+    /// Scroll to a position in pixels, clamped to the text.
+    void scroll_to(const int y)
+    {
+        scroll = y < 0 ? 0 : (y > max_scroll() ? max_scroll() : y);
+    }
+
+    /// Scroll by an amount of pixels.
+    void scroll_by(const int dy)
+    {
+        scroll_to(scroll + dy);
+    }
+
+    /// Show the last lines.
+    void scroll_to_end()
+    {
+        scroll_to(max_scroll());
+    }
+
+    /// Visible lines plus the same amount split above and below, within the
+    /// 512 pixels the PSP allows per texture side.
+    int slab_lines() const
+    {
+        const int visible = rect.h / line_height + 2;
+        if (2 * visible * line_height <= 512)
+            return 2 * visible;
+        return 512 / line_height > visible ? 512 / line_height : visible;
+    }
+
+    /// Wrap a paragraph starting at base in text, adding its lines at the end.
+    void wrap_paragraph(const uint32_t base, std::string_view paragraph)
+    {
+        if (wrap_text(paragraph, atlas, size, h_offset, wrap_width, scratch) == 0)
+            scratch.push_back({0, 0, 0});
+        for (LineSpan span : scratch)
+        {
+            span.offset += base;
+            lines.push_back(span);
+        }
+    }
+
+    /// Follow changes of rect: the lines are wrapped again for a new width and the slab is resized.
+    void refit()
+    {
+        const int capacity = slab_lines();
+        if (rect.w == wrap_width && capacity == slab_capacity)
+            return;
+        if (rect.w != wrap_width)
+        {
+            wrap_width = rect.w;
+            lines.clear();
+            for (size_t i = 0; i < paragraphs.size(); i++)
+            {
+                const uint32_t end = i + 1 < paragraphs.size() ? paragraphs[i + 1] : (uint32_t)text.size();
+                wrap_paragraph(paragraphs[i], std::string_view(text).substr(paragraphs[i], end - paragraphs[i]));
+            }
+            scroll_to(scroll);
+        }
+        slab_capacity = capacity;
+        SIMPLE_TEXT_COUNT(texture_destroys, slab != nullptr);
+        if (slab)
+            SDL_DestroyTexture(slab);
+        slab = nullptr;
+        slab_dirty = true;
+    }
+
+    /// Text of a wrapped line.
+    std::string_view line(const int index) const
+    {
+        return std::string_view(text).substr(lines[index].offset, lines[index].length);
+    }
+
+    /**
+     * Draw the visible lines, redrawing the slab only when they leave it.
+     * @param renderer SDL_Renderer pointer to the current renderer.
+     */
+    void draw(SDL_Renderer *renderer)
+    {
+        SIMPLE_TEXT_TIME_DRAW;
+        refit();
+        if (lines.empty())
+            return;
+        const int first = scroll / line_height;
+        int last = (scroll + rect.h + line_height - 1) / line_height;
+        if (last > (int)lines.size())
+            last = (int)lines.size();
+
+        if (slab == nullptr && !slab_failed)
+        {
+            SIMPLE_TEXT_COUNT(texture_creates, 1);
+            slab = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, rect.w, slab_capacity * line_height);
+            if (slab)
+                SDL_SetTextureBlendMode(slab, SDL_BLENDMODE_BLEND);
+            slab_failed = slab == nullptr;
+            slab_dirty = true;
+        }
+        if (slab == nullptr)
+        {
+            // Without render targets, draw the visible lines clipped to the view,
+            // inside the clip rect of the caller, which is restored after.
+            const bool clipped = SDL_RenderIsClipEnabled(renderer);
+            SDL_Rect previous;
+            SDL_RenderGetClipRect(renderer, &previous);
+            SDL_Rect clip = rect;
+            if (clipped && !SDL_IntersectRect(&rect, &previous, &clip))
+                return;
+            SDL_RenderSetClipRect(renderer, &clip);
+            for (int i = first; i < last; i++)
+                draw_text_batched(line(i), *atlas, batch, rect.x, rect.y + i * line_height - scroll, size, h_offset, color);
+            batch.flush(renderer);
+            SDL_RenderSetClipRect(renderer, clipped ? &previous : nullptr);
+            return;
+        }
+
+        if (slab_dirty || first < slab_first || last > slab_first + slab_capacity)
+        {
+            slab_first = first - (slab_capacity - (last - first)) / 2;
+            if (slab_first < 0)
+                slab_first = 0;
+            slab_count = (int)lines.size() - slab_first < slab_capacity ? (int)lines.size() - slab_first : slab_capacity;
+
+            SDL_Texture *previous = SDL_GetRenderTarget(renderer);
+            SIMPLE_TEXT_COUNT(target_switches, 2);
+            SDL_SetRenderTarget(renderer, slab);
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+            SDL_RenderClear(renderer);
+            for (int i = 0; i < slab_count; i++)
+                draw_text_batched(line(slab_first + i), *atlas, batch, 0, i * line_height, size, h_offset, color);
+            batch.flush(renderer);
+            SDL_SetRenderTarget(renderer, previous);
+            slab_dirty = false;
+        }
+
+        const int offset = scroll - slab_first * line_height;
+        const int slab_height = slab_count * line_height - offset;
+        const int height = slab_height < rect.h ? slab_height : rect.h;
+        if (height <= 0)
+            return;
+        const SDL_Rect source = {0, offset, rect.w, height};
+        const SDL_Rect destiny = {rect.x, rect.y, rect.w, height};
+        SIMPLE_TEXT_COUNT(render_copies, 1);
+        SDL_RenderCopy(renderer, slab, &source, &destiny);
+    }
+};
+
+/**
+ * Queue a label laid out at compile time into a TextBatch.
+ *
+ * @param label StaticLabel built with the table of font_atlas.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param batch TextBatch reference that will receive the glyph quads.
+ * @param x position X inside the current renderer context.
+ * @param y position Y inside the current renderer context.
+ * @param color Color of the text in RGB format.
+ * @param effect shadow and outline queued with the label, nullptr for none.
+ */
+template <size_t N>
+void draw_static_label(const StaticLabel<N> &label,
+                       const FontAtlas &font_atlas,
+                       TextBatch &batch,
+                       const int x,
+                       const int y,
+                       SDL_Color color = {255, 255, 255},
+                       const TextEffect *effect = nullptr)
+{
+    color.a = 255;
+    batch.distance_field |= font_atlas.pixel_format == ATLAS_PIXELS_SDF;
+    if (effect)
+        batch.begin_effect();
+    for (int i = 0; i < label.count; i++)
+    {
+        const int index = label.glyphs[i];
+        if (index >= font_atlas.glyph_count)
+            continue;
+        const SDL_Rect destiny = font_atlas.glyph_destiny(index, x + label.x[i], y, label.size);
+        batch.add_quad(font_atlas.glyph_texture(index), font_atlas.glyph_uvs[index], destiny, color);
+    }
+    if (effect)
+        batch.apply_effect(*effect);
+}
+
+/**
+ * Draw a label laid out at compile time into the renderer, one SDL_RenderCopy per glyph.
+ *
+ * @param label StaticLabel built with the table of font_atlas.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X inside the current renderer context.
+ * @param y position Y inside the current renderer context.
+ */
+template <size_t N>
+void draw_static_label(const StaticLabel<N> &label,
+                       const FontAtlas &font_atlas,
+                       SDL_Renderer *renderer,
+                       const int x,
+                       const int y)
+{
+    SIMPLE_TEXT_TIME_DRAW;
+    for (int i = 0; i < label.count; i++)
+    {
+        const int index = label.glyphs[i];
+        if (index >= font_atlas.glyph_count)
+            continue;
+        const SDL_Rect destiny = font_atlas.glyph_destiny(index, x + label.x[i], y, label.size);
+        SIMPLE_TEXT_COUNT(render_copies, 1);
+        SIMPLE_TEXT_COUNT(glyphs_drawn, 1);
+        SDL_RenderCopy(renderer, font_atlas.glyph_texture(index), &font_atlas.glyph_rects[index], &destiny);
+    }
+}
+
+/**
+ * @brief RGBA buffer that text is drawn into by the raster_* functions, without a renderer.
+ *
+ * Pixels are 4 bytes in R, G, B, A order (SDL_PIXELFORMAT_RGBA32). Used to pre-render
+ * static screens offline and to compare the output of the pipeline in tests.
+ */
+struct TextCanvas
+{
+    uint8_t *pixels = nullptr;
+    int width = 0;
+    int height = 0;
+
+    /// Bytes per row.
+    int pitch = 0;
+
+    TextCanvas(uint8_t *_pixels, const int _width, const int _height, const int _pitch)
+    {
+        pixels = _pixels;
+        width = _width;
+        height = _height;
+        pitch = _pitch;
+    }
+
+    /**
+     * Use the pixels of a surface, which must be SDL_PIXELFORMAT_RGBA32 and stay locked while drawing.
+     */
+    TextCanvas(SDL_Surface *surface)
+    {
+        if (surface == nullptr || surface->format->format != SDL_PIXELFORMAT_RGBA32)
+            return;
+        pixels = (uint8_t *)surface->pixels;
+        width = surface->w;
+        height = surface->h;
+        pitch = surface->pitch;
+    }
+
+    /// Fill every pixel with a color.
+    void clear(const SDL_Color color)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            uint8_t *row = pixels + (size_t)y * pitch;
+            for (int x = 0; x < width; x++)
+                memcpy(row + x * 4, &color, 4);
+        }
+    }
+};
+
+/**
+ * Blend a textured quad into a canvas the way SDL_BLENDMODE_BLEND does, sampling the
+ * nearest texel of every pixel whose center is inside the quad.
+ * @param canvas TextCanvas reference that receives the pixels.
+ * @param image RGBA32 source surface.
+ * @param box destiny box of the quad.
+ * @param uv normalized texture coordinates of the quad.
+ * @param color color multiplied with the texels, alpha included.
+ */
+void raster_quad(TextCanvas &canvas, const SDL_Surface *image, const GlyphQuad &box, const GlyphQuad &uv, const SDL_Color color);
+
+/**
+ * Draw every quad of a TextBatch into a canvas, in the order SDL_RenderGeometry
+ * would, sampling the headless image of the atlas the quads were queued from.
+ * @param canvas TextCanvas reference that receives the pixels.
+ * @param batch TextBatch reference, left untouched.
+ * @param font_atlas FontAtlas created without a renderer.
+ */
+void raster_batch(TextCanvas &canvas, const TextBatch &batch, const FontAtlas &font_atlas);
+
+/**
+ * Headless draw_text, one quad per glyph at the same place draw_text puts it.
+ * @param text string to be drawed.
+ * @param font_atlas FontAtlas created without a renderer.
+ * @param canvas TextCanvas reference that receives the pixels.
+ * @param x position X inside the canvas.
+ * @param y position Y inside the canvas.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param color Color of the text in RGB format.
+ */
+void raster_text(std::string_view text,
+                 const FontAtlas &font_atlas,
+                 TextCanvas &canvas,
+                 const int x,
+                 const int y,
+                 const int size,
+                 const int h_offset = 57,
+                 SDL_Color color = {255, 255, 255});
+
+/**
+ * Headless draw_text_layout, for wrapped texts and typewriter reveals.
+ * @param layout TextLayout reference to be drawed.
+ * @param font_atlas FontAtlas created without a renderer, the layout was built with it.
+ * @param canvas TextCanvas reference that receives the pixels.
+ * @param x position X of the layout origin.
+ * @param y position Y of the layout origin.
+ * @param first index of the first glyph to draw.
+ * @param count amount of glyphs to draw, clamped to the layout size.
+ * @param color Color of the text in RGB format.
+ */
+void raster_text_layout(const TextLayout &layout,
+                        const FontAtlas &font_atlas,
+                        TextCanvas &canvas,
+                        const int x,
+                        const int y,
+                        const size_t first = 0,
+                        size_t count = SIZE_MAX,
+                        SDL_Color color = {255, 255, 255});
+
+#if defined(__psp__) && defined(SIMPLE_TEXT_GU)
+/**
+ * Draw a text line straight into the GE display list as GU_SPRITES, bypassing the
+ * SDL renderer. Pending SDL draws are flushed first so the order is kept, so call it
+ * after the SDL_RenderClear of the frame. Needs an atlas with ATLAS_PIXELS_A8, ATLAS_PIXELS_A4
+ * or ATLAS_PIXELS_SDF.
+ *
+ * @param text string to be drawed.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X inside the current renderer context.
+ * @param y position Y inside the current renderer context.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param color Color of the text in RGB format.
+ * @returns false when nothing was drawn because the atlas has no GE copy, the caller should draw through SDL.
+ */
+bool gu_draw_text(std::string_view text,
+                  const FontAtlas &font_atlas,
+                  SDL_Renderer *renderer,
+                  const int x,
+                  const int y,
+                  const int size,
+                  const int h_offset = 57,
+                  SDL_Color color = {255, 255, 255});
+
+/**
+ * Draw a range of glyphs of a TextLayout straight into the GE display list, see gu_draw_text.
+ * @param layout TextLayout reference to be drawed.
+ * @param font_atlas FontAtlas reference the layout was built with.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X of the layout origin.
+ * @param y position Y of the layout origin.
+ * @param first index of the first glyph to draw.
+ * @param count amount of glyphs to draw.
+ * @param color Color of the text in RGB format.
+ * @returns false when nothing was drawn because the atlas has no GE copy.
+ */
+bool gu_draw_text_layout(const TextLayout &layout,
+                         const FontAtlas &font_atlas,
+                         SDL_Renderer *renderer,
+                         const int x,
+                         const int y,
+                         const size_t first = 0,
+                         size_t count = SIZE_MAX,
+                         SDL_Color color = {255, 255, 255});
+#endif
+
+/**
+ * Draw a text line through a TextCache, building its entry only when the text is new.
+ *
+ * @param cache TextCache reference that stores the drawn texts.
+ * @param text string to be drawed.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X inside the current renderer context.
+ * @param y position Y inside the current renderer context.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param color Color of the text in RGB format.
+ */
+void draw_text_cached(TextCache &cache,
+                      std::string_view text,
+                      const FontAtlas &font_atlas,
+                      SDL_Renderer *renderer,
+                      const int x,
+                      const int y,
+                      const int size,
+                      const int h_offset = 57,
+                      SDL_Color color = {255, 255, 255});
+
+/**
+ * Draw multiline text through a TextCache, wrapping and building its entry only when the text is new.
+ *
+ * @param cache TextCache reference that stores the drawn texts.
+ * @param text string to be drawed.
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param rect SDL_Rect destiny reference.
+ * @param size size of the font when drawing.
+ * @param h_offset horizontal offset between characters in percentage.
+ * @param v_offset vertical offset between characters in percentage.
+ * @param color Color of the text in RGB format.
+ */
+void draw_text_multiline_cached(TextCache &cache,
+                                std::string_view text,
+                                const FontAtlas &font_atlas,
+                                SDL_Renderer *renderer,
+                                const SDL_Rect &rect,
+                                const int size,
+                                const int h_offset = 57,
+                                const int v_offset = 70,
+                                SDL_Color color = {255, 255, 255});
+
+bool is_utf8_start(char c)
+{
+    return ((c & 0xE0) == 0xC0 || (c & 0xF0) == 0xE0 || (c & 0xF8) == 0xF0);
+}
+
+constexpr bool is_utf_cont(char c)
+{
+    return (c & 0xC0) == 0x80;
+}
+
+constexpr uint32_t decode_next(const char *&it, const char *end)
+{
+    const uint8_t c = (uint8_t)*it++;
+    if (c < 0x80)
+        return c;
+
+    uint32_t character = 0;
+    int continuations = 0;
+    if ((c & 0xE0) == 0xC0)
+    {
+        character = c & 0x1F;
+        continuations = 1;
+    }
+    else if ((c & 0xF0) == 0xE0)
+    {
+        character = c & 0x0F;
+        continuations = 2;
+    }
+    else if ((c & 0xF8) == 0xF0)
+    {
+        character = c & 0x07;
+        continuations = 3;
+    }
+    else
+    {
+        return UTF8_INVALID;
+    }
+
+    const char *start = it;
+    for (int i = 0; i < continuations; i++)
+    {
+        if (it == end || !is_utf_cont(*it))
+        {
+            it = start;
+            return UTF8_INVALID;
+        }
+        character = (character << 6) | ((uint8_t)*it++ & 0x3F);
+    }
+    return character;
+}
+
+size_t decode_utf8(std::string_view text, uint32_t *out, size_t capacity)
+{
+    SIMPLE_TEXT_TIME_DECODE;
+    const char *it = text.data();
+    const char *end = it + text.size();
+    size_t count = 0;
+    while (it < end && count < capacity)
+    {
+        out[count++] = decode_next(it, end);
+    }
+    return count;
+}
+
+size_t utf8_length(std::string_view text)
+{
+    const char *it = text.data();
+    const char *end = it + text.size();
+    size_t count = 0;
+    while (it < end)
+    {
+        decode_next(it, end);
+        count++;
+    }
+    return count;
+}
+
+int encode_utf8(uint32_t character, char *out)
+{
+    if (character > 0x10FFFF || (character >= 0xD800 && character <= 0xDFFF))
+        character = UTF8_INVALID;
+    if (character < 0x80)
+    {
+        out[0] = (char)character;
+        return 1;
+    }
+    if (character < 0x800)
+    {
+        out[0] = (char)(0xC0 | (character >> 6));
+        out[1] = (char)(0x80 | (character & 0x3F));
+        return 2;
+    }
+    if (character < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (character >> 12));
+        out[1] = (char)(0x80 | ((character >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (character & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (character >> 18));
+    out[1] = (char)(0x80 | ((character >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((character >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (character & 0x3F));
+    return 4;
+}
+
+void swizzle_pixels(const uint8_t *src, uint8_t *dst, const int row_bytes, const int height, const bool swizzle)
+{
+    const int blocks_per_row = row_bytes / 16;
+    for (int by = 0; by < height / 8; by++)
+    {
+        for (int bx = 0; bx < blocks_per_row; bx++)
+        {
+            for (int row = 0; row < 8; row++)
+            {
+                const size_t linear = (size_t)(by * 8 + row) * row_bytes + bx * 16;
+                const size_t swizzled = ((size_t)(by * blocks_per_row + bx) * 8 + row) * 16;
+                if (swizzle)
+                    memcpy(dst + swizzled, src + linear, 16);
+                else
+                    memcpy(dst + linear, src + swizzled, 16);
+            }
+        }
+    }
+}
+
+void build_distance_field(const uint8_t *coverage, uint8_t *out, const int w, const int h, const int cell_w, const int cell_h, const int spread)
+{
+    const int limit = spread * spread;
+    for (int y = 0; y < h; y++)
+    {
+        const int cell_y0 = y / cell_h * cell_h;
+        const int cell_y1 = cell_y0 + cell_h < h ? cell_y0 + cell_h : h;
+        for (int x = 0; x < w; x++)
+        {
+            const int cell_x0 = x / cell_w * cell_w;
+            const int cell_x1 = cell_x0 + cell_w < w ? cell_x0 + cell_w : w;
+            const bool inside = coverage[(size_t)y * w + x] >= 128;
+
+            // Nearest pixel on the other side of the edge, inside the same cell.
+            int nearest = limit;
+            for (int sy = y - spread; sy <= y + spread; sy++)
+            {
+                if (sy < cell_y0 || sy >= cell_y1)
+                    continue;
+                const uint8_t *row = coverage + (size_t)sy * w;
+                for (int sx = x - spread; sx <= x + spread; sx++)
+                {
+                    if (sx < cell_x0 || sx >= cell_x1 || (row[sx] >= 128) == inside)
+                        continue;
+                    const int d = (sx - x) * (sx - x) + (sy - y) * (sy - y);
+                    if (d < nearest)
+                        nearest = d;
+                }
+            }
+
+            // The edge lies halfway between the two pixels.
+            const float distance = sqrtf((float)nearest) - 0.5f;
+            const float signed_distance = inside ? distance : -distance;
+            int value = 128 + (int)lroundf(signed_distance * 127.0f / spread);
+            out[(size_t)y * w + x] = (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+        }
+    }
+}
 
+#ifdef SIMPLE_TEXT_SDF_GL
 /**
- * Split a text into a vector of strings using newline character as separator.
- * @param input_string reference to the original text.
- * @returns splitted text
+ * @brief Fragment shader of sdf_gl_draw and the GL 2.0 functions it needs, loaded on first use.
  */
-std::vector<std::string> split_string_by_newline(const std::string &input_string);
+struct SdfGlProgram
+{
+    bool loaded = false;
+    GLuint program = 0;
+    GLint atlas_uniform = -1;
+    PFNGLCREATESHADERPROC CreateShader = nullptr;
+    PFNGLSHADERSOURCEPROC ShaderSource = nullptr;
+    PFNGLCOMPILESHADERPROC CompileShader = nullptr;
+    PFNGLGETSHADERIVPROC GetShaderiv = nullptr;
+    PFNGLCREATEPROGRAMPROC CreateProgram = nullptr;
+    PFNGLATTACHSHADERPROC AttachShader = nullptr;
+    PFNGLLINKPROGRAMPROC LinkProgram = nullptr;
+    PFNGLGETPROGRAMIVPROC GetProgramiv = nullptr;
+    PFNGLUSEPROGRAMPROC UseProgram = nullptr;
+    PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation = nullptr;
+    PFNGLUNIFORM1IPROC Uniform1i = nullptr;
+
+    /// Compile the shader, needs the GL context of the renderer to be current.
+    bool load()
+    {
+        if (loaded)
+            return program != 0;
+        loaded = true;
+        CreateShader = (PFNGLCREATESHADERPROC)SDL_GL_GetProcAddress("glCreateShader");
+        ShaderSource = (PFNGLSHADERSOURCEPROC)SDL_GL_GetProcAddress("glShaderSource");
+        CompileShader = (PFNGLCOMPILESHADERPROC)SDL_GL_GetProcAddress("glCompileShader");
+        GetShaderiv = (PFNGLGETSHADERIVPROC)SDL_GL_GetProcAddress("glGetShaderiv");
+        CreateProgram = (PFNGLCREATEPROGRAMPROC)SDL_GL_GetProcAddress("glCreateProgram");
+        AttachShader = (PFNGLATTACHSHADERPROC)SDL_GL_GetProcAddress("glAttachShader");
+        LinkProgram = (PFNGLLINKPROGRAMPROC)SDL_GL_GetProcAddress("glLinkProgram");
+        GetProgramiv = (PFNGLGETPROGRAMIVPROC)SDL_GL_GetProcAddress("glGetProgramiv");
+        UseProgram = (PFNGLUSEPROGRAMPROC)SDL_GL_GetProcAddress("glUseProgram");
+        GetUniformLocation = (PFNGLGETUNIFORMLOCATIONPROC)SDL_GL_GetProcAddress("glGetUniformLocation");
+        Uniform1i = (PFNGLUNIFORM1IPROC)SDL_GL_GetProcAddress("glUniform1i");
+        if (!CreateShader || !ShaderSource || !CompileShader || !GetShaderiv || !CreateProgram || !AttachShader ||
+            !LinkProgram || !GetProgramiv || !UseProgram || !GetUniformLocation || !Uniform1i)
+            return false;
+
+        // Fixed function vertices, the field is cut at 0.5 and smoothed over one screen pixel.
+        static const char *source =
+            "#version 110\n"
+            "uniform sampler2D atlas;\n"
+            "void main()\n"
+            "{\n"
+            "    float distance = texture2D(atlas, gl_TexCoord[0].xy).a;\n"
+            "    float width = fwidth(distance) * 0.5;\n"
+            "    float alpha = smoothstep(0.5 - width, 0.5 + width, distance);\n"
+            "    gl_FragColor = vec4(gl_Color.rgb, gl_Color.a * alpha);\n"
+            "}\n";
+        const GLuint shader = CreateShader(GL_FRAGMENT_SHADER);
+        ShaderSource(shader, 1, &source, nullptr);
+        CompileShader(shader);
+        GLint status = 0;
+        GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (!status)
+            return false;
+        const GLuint linked = CreateProgram();
+        AttachShader(linked, shader);
+        LinkProgram(linked);
+        GetProgramiv(linked, GL_LINK_STATUS, &status);
+        if (!status)
+            return false;
+        program = linked;
+        atlas_uniform = GetUniformLocation(program, "atlas");
+        return true;
+    }
+};
+
+bool sdf_gl_draw(const TextBatch &batch, SDL_Renderer *renderer)
+{
+    static SdfGlProgram sdf;
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) != 0 || strcmp(info.name, "opengl") != 0 || !sdf.load())
+        return false;
+
+    // SDL state is restored afterwards, its own queued draws go out first.
+    SDL_RenderFlush(renderer);
+    GLint previous_program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_CURRENT_BIT);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    sdf.UseProgram(sdf.program);
+    sdf.Uniform1i(sdf.atlas_uniform, 0);
+    for (size_t i = 0; i < batch.used_buckets; i++)
+    {
+        const TextBatch::Bucket &b = batch.buckets[i];
+        float scale_u = 1.0f;
+        float scale_v = 1.0f;
+        if (b.indices.empty() || SDL_GL_BindTexture(b.texture, &scale_u, &scale_v) != 0)
+            continue;
+        SIMPLE_TEXT_COUNT(geometry_draws, 1);
+        SIMPLE_TEXT_COUNT(glyphs_drawn, b.indices.size() / 6);
+        glBegin(GL_TRIANGLES);
+        for (int index : b.indices)
+        {
+            const SDL_Vertex &v = b.vertices[index];
+            glColor4ub(v.color.r, v.color.g, v.color.b, v.color.a);
+            glTexCoord2f(v.tex_coord.x * scale_u, v.tex_coord.y * scale_v);
+            glVertex2f(v.position.x, v.position.y);
+        }
+        glEnd();
+        SDL_GL_UnbindTexture(b.texture);
+    }
+    sdf.UseProgram((GLuint)previous_program);
+    glPopAttrib();
+    return true;
+}
+#endif
+
+std::vector<uint32_t> get_utf8_char_vector(const char *text)
+{
+    SIMPLE_TEXT_TIME_DECODE;
+    std::string_view view(text);
+    std::vector<uint32_t> converted(utf8_length(view));
+    decode_utf8(view, converted.data(), converted.size());
+    return converted;
+}
+
+int get_char_index(uint32_t character, const char *atlas)
+{
+    int i = 0;
+    for (auto c : Utf8Text(atlas))
+    {
+        if (c == character)
+            return i;
+        i++;
+    }
+    return -1;
+}
+
+constexpr SDL_Rect get_atlas_rect_by_index(const int index, const int atlas_width, const int atlas_height, const int cell_width, const int cell_height)
+{
+    SDL_Rect rect = {0, 0, 0, 0};
+    int cells_per_row = atlas_width / cell_width;
+
+    int row = index / cells_per_row;
+    int col = index % cells_per_row;
+
+    rect.x = col * cell_width;
+    rect.y = row * cell_height;
+    rect.w = cell_width;
+    rect.h = cell_height;
+
+    return rect;
+}
+
+std::string remove_new_lines(const std::string &input_string)
+{
+    std::string result;
+    result.reserve(input_string.size());
+    for (char c : input_string)
+    {
+        if (c != '\n')
+            result.push_back(c);
+    }
+    return result;
+}
+
+std::vector<std::string> split_string_by_newline(const std::string &input_string)
+{
+    std::vector<std::string> result;
+    size_t start = 0;
+    while (start < input_string.size())
+    {
+        size_t found = input_string.find('\n', start);
+        if (found == std::string::npos)
+            found = input_string.size();
+        result.push_back(input_string.substr(start, found - start));
+        start = found + 1;
+    }
+    return result;
+}
+
+template <typename Emit>
+size_t wrap_text_each(std::string_view text,
+                      const FontAtlas *font_atlas,
+                      const int size,
+                      const int h_offset,
+                      const int max_length,
+                      Emit emit)
+{
+    SIMPLE_TEXT_TIME_WRAP;
+    size_t count = 0;
+    const int mono_advance = size - (h_offset * size / 100);
+    const int space_advance = font_atlas ? font_atlas->glyph_advance(-1, size, h_offset) : mono_advance;
+
+    const char *base = text.data();
+    const char *it = base;
+    const char *end = base + text.size();
+
+    // Words already placed on the current line.
+    uint32_t line_start = 0;
+    uint32_t line_end = 0;
+    int line_width = 0;
+    bool line_has_words = false;
+
+    // Word being measured, and the spaces between it and the line.
+    uint32_t word_start = 0;
+    uint32_t word_end = 0;
+    int word_width = 0;
+    bool in_word = false;
+    int spaces_width = 0;
+    int previous = -1;
+
+    auto place_word = [&]()
+    {
+        if (!in_word)
+            return;
+        if (!line_has_words)
+        {
+            line_width = spaces_width + word_width;
+            line_has_words = true;
+        }
+        else if (line_width + spaces_width + word_width > max_length)
+        {
+            emit(LineSpan{line_start, line_end - line_start, line_width});
+            count++;
+            line_start = word_start;
+            line_width = word_width;
+        }
+        else
+        {
+            line_width += spaces_width + word_width;
+        }
+        line_end = word_end;
+        spaces_width = 0;
+        in_word = false;
+    };
+
+    while (it < end)
+    {
+        const uint32_t pos = (uint32_t)(it - base);
+        const uint32_t c = decode_next(it, end);
+        if (c == '\n')
+        {
+            place_word();
+            emit(LineSpan{line_start, line_end - line_start, line_width});
+            count++;
+            line_start = (uint32_t)(it - base);
+            line_end = line_start;
+            line_width = 0;
+            line_has_words = false;
+            spaces_width = 0;
+            previous = -1;
+            continue;
+        }
+        if (c == ' ' || c == '\t')
+        {
+            // Tabs allow a break but, like any character missing from the atlas, draw nothing.
+            place_word();
+            if (c == ' ')
+                spaces_width += space_advance;
+            previous = -1;
+            continue;
+        }
+        if (c == '\r')
+            continue;
+
+        if (!in_word)
+        {
+            in_word = true;
+            word_start = pos;
+            word_width = 0;
+        }
+        word_end = (uint32_t)(it - base);
+        if (font_atlas == nullptr)
+        {
+            word_width += mono_advance;
+            continue;
+        }
+        const int index = font_atlas->glyph_index(c);
+        if (index == -1)
+            continue;
+        word_width += font_atlas->kerning(previous, index, size) + font_atlas->glyph_advance(index, size, h_offset);
+        previous = index;
+    }
+    place_word();
+    if (line_has_words)
+    {
+        emit(LineSpan{line_start, line_end - line_start, line_width});
+        count++;
+    }
+    return count;
+}
+
+size_t wrap_text(std::string_view text,
+                 const FontAtlas *font_atlas,
+                 const int size,
+                 const int h_offset,
+                 const int max_length,
+                 std::vector<LineSpan> &lines)
+{
+    lines.clear();
+    return wrap_text_each(text, font_atlas, size, h_offset, max_length, [&](const LineSpan &span)
+                          { lines.push_back(span); });
+}
+
+/**
+ * Copy the text of each line span into its own string.
+ */
+std::vector<std::string> lines_from_spans(const std::string &text, const std::vector<LineSpan> &spans)
+{
+    std::vector<std::string> result;
+    result.reserve(spans.size());
+    for (const auto &span : spans)
+    {
+        result.push_back(text.substr(span.offset, span.length));
+    }
+    return result;
+}
+
+std::vector<std::string> split_text_by_size(const std::string &text, const int size, const int h_offset, const int max_length)
+{
+    std::vector<LineSpan> spans;
+    wrap_text(text, nullptr, size, h_offset, max_length, spans);
+    return lines_from_spans(text, spans);
+}
+
+std::vector<std::string> split_text_by_size(const std::string &text, const FontAtlas &font_atlas, const int size, const int h_offset, const int max_length)
+{
+    std::vector<LineSpan> spans;
+    wrap_text(text, &font_atlas, size, h_offset, max_length, spans);
+    return lines_from_spans(text, spans);
+}
+
+int measure_text(std::string_view text, const FontAtlas &font_atlas, const int size, const int h_offset)
+{
+    int width = 0;
+    int previous = -1;
+    for (auto c : Utf8Text(text))
+    {
+        const int index = c == ' ' ? -1 : font_atlas.glyph_index(c);
+        if (c != ' ' && index == -1)
+            continue;
+        width += font_atlas.kerning(previous, index, size) + font_atlas.glyph_advance(index, size, h_offset);
+        previous = index;
+    }
+    return width;
+}
+
+std::vector<std::string> get_all_lines(const std::string &text, const FontAtlas &font_atlas, const int size, const int h_offset, const int max_length)
+{
+    return split_text_by_size(text, font_atlas, size, h_offset, max_length);
+}
+
+std::vector<std::string> get_all_lines(const std::string &text, const int size, const int h_offset, const int max_length)
+{
+    return split_text_by_size(text, size, h_offset, max_length);
+}
+
+void build_text_layout(TextLayout &layout,
+                       const std::string &text,
+                       const FontAtlas &font_atlas,
+                       const int size,
+                       const int h_offset,
+                       const int v_offset,
+                       const int max_length)
+{
+    SIMPLE_TEXT_COUNT(layout_builds, 1);
+    layout.glyphs.clear();
+    layout.line_starts.clear();
+    layout.quads.clear();
+    layout.quad_uvs.clear();
+    layout.quad_glyphs.clear();
+    layout.quad_runs.clear();
+    layout.plain.clear();
+    layout.runs.clear();
+    layout.markers.clear();
+
+    const int line_height = size * v_offset / 100;
+    wrap_text(text, &font_atlas, size, h_offset, max_length, layout.lines);
+    for (int i = 0; i < (int)layout.lines.size(); i++)
+    {
+        layout.line_starts.push_back((int)layout.glyphs.size());
+        int current_x = 0;
+        int previous = -1;
+        for (auto c : Utf8Text(std::string_view(text).substr(layout.lines[i].offset, layout.lines[i].length)))
+        {
+            const int index = c == ' ' ? -1 : font_atlas.glyph_index(c);
+            if (c != ' ' && index == -1)
+                continue;
+            current_x += font_atlas.kerning(previous, index, size);
+            layout.glyphs.push_back({c, index, current_x, i * line_height, (int)layout.quads.size()});
+            if (index != -1)
+            {
+                // The integer scaling is done once here, drawing only offsets the boxes.
+                const SDL_Rect box = font_atlas.glyph_destiny(index, current_x, i * line_height, size);
+                const SDL_FRect &uv = font_atlas.glyph_uvs[index];
+                layout.quads.push_back({(float)box.x, (float)box.y, (float)(box.x + box.w), (float)(box.y + box.h)});
+                layout.quad_uvs.push_back({uv.x, uv.y, uv.x + uv.w, uv.y + uv.h});
+                layout.quad_glyphs.push_back(index);
+            }
+            current_x += font_atlas.glyph_advance(index, size, h_offset);
+            previous = index;
+        }
+    }
+
+    layout.text_data = text.data();
+    layout.text_size = text.size();
+    layout.size = size;
+    layout.h_offset = h_offset;
+    layout.v_offset = v_offset;
+    layout.max_width = max_length;
+    layout.valid = true;
+}
+
+void draw_text_layout(const TextLayout &layout,
+                      const FontAtlas &font_atlas,
+                      SDL_Renderer *renderer,
+                      const int x,
+                      const int y,
+                      const size_t first,
+                      size_t count)
+{
+    SIMPLE_TEXT_TIME_DRAW;
+    if (first >= layout.glyphs.size())
+        return;
+    if (count > layout.glyphs.size() - first)
+        count = layout.glyphs.size() - first;
+    for (size_t i = first; i < first + count; i++)
+    {
+        const LayoutGlyph &g = layout.glyphs[i];
+        if (g.index == -1)
+            continue;
+        SDL_Rect destiny = font_atlas.glyph_destiny(g.index, x + g.x, y + g.y, layout.size);
+        SIMPLE_TEXT_COUNT(render_copies, 1);
+        SIMPLE_TEXT_COUNT(glyphs_drawn, 1);
+        SDL_RenderCopy(renderer, font_atlas.glyph_texture(g.index), &font_atlas.glyph_rects[g.index], &destiny);
+    }
+}
+
+static_assert(sizeof(SDL_Vertex) == 20, "build_quad_vertices writes SDL_Vertex as 5 floats");
+
+/**
+ * Write the 4 vertices of a quad from its box already moved to the origin.
+ */
+inline void write_quad_vertices(const float *box, const GlyphQuad &uv, const SDL_Color color, SDL_Vertex *out)
+{
+    out[0] = {{box[0], box[1]}, color, {uv.x0, uv.y0}};
+    out[1] = {{box[2], box[1]}, color, {uv.x1, uv.y0}};
+    out[2] = {{box[2], box[3]}, color, {uv.x1, uv.y1}};
+    out[3] = {{box[0], box[3]}, color, {uv.x0, uv.y1}};
+}
+
+void build_quad_vertices(const GlyphQuad *boxes,
+                         const GlyphQuad *uvs,
+                         const size_t count,
+                         const float origin_x,
+                         const float origin_y,
+                         const SDL_Color color,
+                         SDL_Vertex *out)
+{
+    size_t i = 0;
+#if defined(SIMPLE_TEXT_SSE)
+    uint32_t color_bits;
+    memcpy(&color_bits, &color, 4);
+    const __m128 origin = _mm_setr_ps(origin_x, origin_y, origin_x, origin_y);
+    const __m128 c = _mm_castsi128_ps(_mm_set1_epi32((int)color_bits));
+    float *f = (float *)out;
+    for (; i + 4 <= count; i += 4)
+    {
+        for (size_t k = i; k < i + 4; k++)
+        {
+            // p = x0 y0 x1 y1, t = u0 v0 u1 v1, written as 5 stores of x y color u v.
+            const __m128 p = _mm_add_ps(_mm_load_ps(&boxes[k].x0), origin);
+            const __m128 t = _mm_load_ps(&uvs[k].x0);
+            const __m128 s0 = _mm_movelh_ps(p, _mm_unpacklo_ps(c, t));
+            const __m128 s1 = _mm_shuffle_ps(_mm_shuffle_ps(t, p, _MM_SHUFFLE(2, 2, 1, 1)),
+                                             _mm_shuffle_ps(p, c, _MM_SHUFFLE(0, 0, 1, 1)), _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 s2 = _mm_shuffle_ps(t, p, _MM_SHUFFLE(3, 2, 1, 2));
+            const __m128 s3 = _mm_shuffle_ps(_mm_shuffle_ps(c, t, _MM_SHUFFLE(3, 2, 0, 0)),
+                                             _mm_shuffle_ps(t, p, _MM_SHUFFLE(0, 0, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 s4 = _mm_shuffle_ps(_mm_shuffle_ps(p, c, _MM_SHUFFLE(0, 0, 3, 3)), t, _MM_SHUFFLE(3, 0, 2, 0));
+            float *q = f + k * 20;
+            _mm_storeu_ps(q, s0);
+            _mm_storeu_ps(q + 4, s1);
+            _mm_storeu_ps(q + 8, s2);
+            _mm_storeu_ps(q + 12, s3);
+            _mm_storeu_ps(q + 16, s4);
+        }
+    }
+#elif defined(SIMPLE_TEXT_NEON)
+    const float origin_values[4] = {origin_x, origin_y, origin_x, origin_y};
+    const float32x4_t origin = vld1q_f32(origin_values);
+    for (; i + 4 <= count; i += 4)
+    {
+        float moved[16];
+        vst1q_f32(moved, vaddq_f32(vld1q_f32(&boxes[i].x0), origin));
+        vst1q_f32(moved + 4, vaddq_f32(vld1q_f32(&boxes[i + 1].x0), origin));
+        vst1q_f32(moved + 8, vaddq_f32(vld1q_f32(&boxes[i + 2].x0), origin));
+        vst1q_f32(moved + 12, vaddq_f32(vld1q_f32(&boxes[i + 3].x0), origin));
+        for (size_t k = 0; k < 4; k++)
+            write_quad_vertices(moved + k * 4, uvs[i + k], color, out + (i + k) * 4);
+    }
+#elif defined(SIMPLE_TEXT_VFPU)
+    alignas(16) const float origin_values[4] = {origin_x, origin_y, origin_x, origin_y};
+    for (; i + 4 <= count; i += 4)
+    {
+        alignas(16) float moved[16];
+        __asm__ volatile(
+            "lv.q    C100, %4\n"
+            "lv.q    C000, %0\n"
+            "lv.q    C010, %1\n"
+            "lv.q    C020, %2\n"
+            "lv.q    C030, %3\n"
+            "vadd.q  C000, C000, C100\n"
+            "vadd.q  C010, C010, C100\n"
+            "vadd.q  C020, C020, C100\n"
+            "vadd.q  C030, C030, C100\n"
+            "sv.q    C000, 0(%5)\n"
+            "sv.q    C010, 16(%5)\n"
+            "sv.q    C020, 32(%5)\n"
+            "sv.q    C030, 48(%5)\n"
+            :
+            : "m"(boxes[i]), "m"(boxes[i + 1]), "m"(boxes[i + 2]), "m"(boxes[i + 3]), "m"(*origin_values), "r"(moved)
+            : "memory");
+        for (size_t k = 0; k < 4; k++)
+            write_quad_vertices(moved + k * 4, uvs[i + k], color, out + (i + k) * 4);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        const float moved[4] = {boxes[i].x0 + origin_x, boxes[i].y0 + origin_y, boxes[i].x1 + origin_x, boxes[i].y1 + origin_y};
+        write_quad_vertices(moved, uvs[i], color, out + i * 4);
+    }
+}
+
+void draw_text_layout_batched(const TextLayout &layout,
+                              const FontAtlas &font_atlas,
+                              TextBatch &batch,
+                              const int x,
+                              const int y,
+                              const size_t first,
+                              size_t count,
+                              SDL_Color color,
+                              const TextEffect *effect)
+{
+    SIMPLE_TEXT_TIME_DRAW;
+    if (first >= layout.glyphs.size())
+        return;
+    if (count > layout.glyphs.size() - first)
+        count = layout.glyphs.size() - first;
+    color.a = 255;
+    batch.distance_field |= font_atlas.pixel_format == ATLAS_PIXELS_SDF;
+    if (effect)
+        batch.begin_effect();
+    size_t begin = layout.glyphs[first].quad;
+    const size_t end = first + count < layout.glyphs.size() ? layout.glyphs[first + count].quad : layout.quads.size();
+
+    // Runs of quads from the same page share a bucket.
+    while (begin < end)
+    {
+        const int page = font_atlas.glyph_page(layout.quad_glyphs[begin]);
+        size_t run = begin + 1;
+        while (run < end && font_atlas.glyph_page(layout.quad_glyphs[run]) == page)
+            run++;
+        SDL_Vertex *out = batch.reserve_quads(font_atlas.glyph_texture(layout.quad_glyphs[begin]), run - begin);
+        build_quad_vertices(layout.quads.data() + begin, layout.quad_uvs.data() + begin, run - begin, (float)x, (float)y, color, out);
+        begin = run;
+    }
+    if (effect)
+        batch.apply_effect(*effect);
+}
+
+int get_current_line(const std::vector<std::string> &lines, const int current_char)
+{
+    int total_chars = 0;
+
+    for (int i = 0; i < lines.size(); i++)
+    {
+        total_chars += utf8_length(lines[i]) + 1;
+
+        if (total_chars > current_char)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
 
 /**
- * Split a text into a vector of strings when the horizontal draw size is too long.
- * @param text reference to the original text.
+ * Draw characters into the current render target, one SDL_RenderCopy per glyph.
+ *
+ * @param characters range of decoded characters (Utf8Text or Utf32Text).
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param x position X inside the current render target.
+ * @param y position Y inside the current render target.
  * @param size size of the font when drawing.
  * @param h_offset horizontal offset between characters in percentage.
- * @param max_length max horizontal draw size per line.
- * @returns splitted text
+ * @returns position X after the last character.
  */
-std::vector<std::string> split_text_by_size(const std::string &text, const int size, const int h_offset, const int max_length);
+template <typename Characters>
+int draw_glyph_run(const Characters &characters,
+                   const FontAtlas &font_atlas,
+                   SDL_Renderer *renderer,
+                   const int x,
+                   const int y,
+                   const int size,
+                   const int h_offset)
+{
+    int current_x = x;
+    int previous = -1;
+    for (auto c : characters)
+    {
+        const int index = c == ' ' ? -1 : font_atlas.glyph_index(c);
+        if (c != ' ' && index == -1)
+            continue;
+        current_x += font_atlas.kerning(previous, index, size);
+        if (index != -1)
+        {
+            SDL_Rect destiny = font_atlas.glyph_destiny(index, current_x, y, size);
+            SIMPLE_TEXT_COUNT(render_copies, 1);
+            SIMPLE_TEXT_COUNT(glyphs_drawn, 1);
+            SDL_RenderCopy(renderer, font_atlas.glyph_texture(index), &font_atlas.glyph_rects[index], &destiny);
+        }
+        current_x += font_atlas.glyph_advance(index, size, h_offset);
+        previous = index;
+    }
+    return current_x;
+}
 
 /**
- * Split a text into a vector of strings using newline as separator and breaking the
- * line when the horizontal draw sie is too long.
- * @param text reference to the original text.
+ * Get the screen region covered by a run of characters.
+ *
+ * @param characters range of decoded characters (Utf8Text or Utf32Text).
+ * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param x position X inside the current renderer context.
+ * @param y position Y inside the current renderer context.
  * @param size size of the font when drawing.
  * @param h_offset horizontal offset between characters in percentage.
- * @param max_length max horizontal draw size per line.
- * @returns splitted text
+ * @returns bounding rect, at least one line tall.
  */
-std::vector<std::string> get_all_lines(const std::string &text, const int size, const int h_offset, const int max_length);
+template <typename Characters>
+SDL_Rect glyph_run_bounds(const Characters &characters,
+                          const FontAtlas &font_atlas,
+                          const int x,
+                          const int y,
+                          const int size,
+                          const int h_offset)
+{
+    SDL_Rect bounds = {x, y, 0, size};
+    int current_x = x;
+    int previous = -1;
+    for (auto c : characters)
+    {
+        const int index = c == ' ' ? -1 : font_atlas.glyph_index(c);
+        if (c != ' ' && index == -1)
+            continue;
+        current_x += font_atlas.kerning(previous, index, size);
+        if (index != -1)
+        {
+            SDL_Rect destiny = font_atlas.glyph_destiny(index, current_x, y, size);
+            SDL_UnionRect(&bounds, &destiny, &bounds);
+        }
+        current_x += font_atlas.glyph_advance(index, size, h_offset);
+        previous = index;
+    }
+    if (current_x > bounds.x + bounds.w)
+        bounds.w = current_x - bounds.x;
+    return bounds;
+}
 
 /**
- * Get the line of a splitted text by a current char index.
+ * Prepare a CombinedTexture to receive glyphs and make it the current render target.
+ * The texture is created on first use with the size of area, and grown keeping
+ * its content if a later draw falls outside of it.
  *
- * @param lines splitted text, stored as a vector of strings.
- * @param current_char index of the current char.
- * @returns index of the current line.
+ * @param target CombineTexture pointer to the texture that will store the text.
+ * @param renderer SDL_Renderer pointer to the current renderer.
+ * @param area screen region that will be drawn.
+ * @returns false if the texture already holds the finished text.
  */
-int get_current_line(const std::vector<std::string> &lines, const int current_char);
+bool begin_target_draw(CombinedTexture *target, SDL_Renderer *renderer, const SDL_Rect &area)
+{
+    if (target->texture && target->finished)
+        return false;
+
+    SDL_Rect needed = area;
+    if (needed.w < 1)
+        needed.w = 1;
+    if (needed.h < 1)
+        needed.h = 1;
+
+    SDL_Rect covered;
+    if (target->texture && SDL_IntersectRect(&target->area, &needed, &covered) &&
+        covered.w == needed.w && covered.h == needed.h)
+    {
+        SIMPLE_TEXT_COUNT(target_switches, SDL_GetRenderTarget(renderer) != target->texture);
+        if (SDL_GetRenderTarget(renderer) != target->texture)
+            SDL_SetRenderTarget(renderer, target->texture);
+        return true;
+    }
+
+    SDL_Texture *previous = target->texture;
+    SDL_Rect previous_area = target->area;
+    if (previous)
+        SDL_UnionRect(&previous_area, &needed, &needed);
+
+    target->texture = target->acquire_texture(renderer, needed.w, needed.h);
+    target->area = needed;
+    SIMPLE_TEXT_COUNT(target_switches, 1);
+    SDL_SetRenderTarget(renderer, target->texture);
+    SDL_SetTextureBlendMode(target->texture, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+    if (previous)
+    {
+        const SDL_Rect source = {0, 0, previous_area.w, previous_area.h};
+        SDL_Rect old = {previous_area.x - needed.x, previous_area.y - needed.y, previous_area.w, previous_area.h};
+        SDL_SetTextureBlendMode(previous, SDL_BLENDMODE_NONE);
+        SIMPLE_TEXT_COUNT(render_copies, 1);
+        SDL_RenderCopy(renderer, previous, &source, &old);
+        target->release_texture(previous);
+    }
+    return true;
+}
 
 /**
- * Draw a text line into a single texture (if provided) or into the renderer.
+ * Go back to the default render target and show the CombinedTexture.
  *
- * @param text string to be drawed.
- * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
+ * @param target CombineTexture pointer to the texture that stores the text.
  * @param renderer SDL_Renderer pointer to the current renderer.
- * @param x position X inside the current renderer context.
- * @param y position Y inside the current renderer context.
- * @param size size of the font when drawing.
- * @param h_offset horizontal offset between characters in percentage.
- * @param target CombineTexture pointer to the texture that will store the text.
- * @param color Color of the text in RGB format.
  */
-void draw_text(const std::string &text,
+void end_target_draw(CombinedTexture *target, SDL_Renderer *renderer)
+{
+    if (SDL_GetRenderTarget(renderer) != nullptr)
+    {
+        SIMPLE_TEXT_COUNT(target_switches, 1);
+        SDL_SetRenderTarget(renderer, nullptr);
+    }
+    target->blit(renderer);
+}
+
+/**
+ * Draw characters into a CombinedTexture (if provided) or into the renderer.
+ * The render target is switched only once, no matter how many glyphs are drawn.
+ */
+template <typename Characters>
+void draw_characters(const Characters &characters,
+                     const FontAtlas &font_atlas,
+                     SDL_Renderer *renderer,
+                     const int x,
+                     const int y,
+                     const int size,
+                     const int h_offset,
+                     CombinedTexture *target,
+                     SDL_Color color)
+{
+    if (target == nullptr)
+    {
+        draw_glyph_run(characters, font_atlas, renderer, x, y, size, h_offset);
+        return;
+    }
+    if (target->texture == nullptr || !target->finished)
+    {
+        const SDL_Rect area = glyph_run_bounds(characters, font_atlas, x, y, size, h_offset);
+        begin_target_draw(target, renderer, area);
+
+        const SDL_Color previous = font_atlas.set_color_mod(color);
+        draw_glyph_run(characters, font_atlas, renderer, x - target->area.x, y - target->area.y, size, h_offset);
+        font_atlas.set_color_mod(previous);
+        target->finished = true;
+    }
+    end_target_draw(target, renderer);
+}
+
+void draw_text(std::string_view text,
                const FontAtlas &font_atlas,
                SDL_Renderer *renderer,
                const int x,
                const int y,
                const int size,
-               const int h_offset = 57,
-               CombinedTexture *target = nullptr,
-               SDL_Color color = {255, 255, 255});
+               const int h_offset,
+               CombinedTexture *target,
+               SDL_Color color)
+{
+    SIMPLE_TEXT_TIME_DRAW;
+#if defined(__psp__) && defined(SIMPLE_TEXT_GU)
+    if (target == nullptr && gu_draw_text(text, font_atlas, renderer, x, y, size, h_offset, font_atlas.color_mod))
+        return;
+#endif
+    draw_characters(Utf8Text(text), font_atlas, renderer, x, y, size, h_offset, target, color);
+}
 
-/**
- * Draw a text line into a single texture (if provided) or into the renderer.
- *
- * @param utf8_text text as uint32_t utf8 char vector.
- * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
- * @param renderer SDL_Renderer pointer to the current renderer.
- * @param x position X inside the current renderer context.
- * @param y position Y inside the current renderer context.
- * @param size size of the font when drawing.
- * @param h_offset horizontal offset between characters in percentage.
- * @param target CombineTexture pointer to the texture that will store the text.
- * @param color Color of the text in RGB format.
- */
-void draw_utf8_text(const std::vector<uint32_t> utf8_text,
+void draw_utf8_text(const std::vector<uint32_t> &utf8_text,
                     const FontAtlas &font_atlas,
                     SDL_Renderer *renderer,
                     const int x,
@@ -236,560 +5995,1117 @@ void draw_utf8_text(const std::vector<uint32_t> utf8_text,
                     const int size,
                     const int h_offset,
                     CombinedTexture *target,
-                    SDL_Color color = {255, 255, 255});
+                    SDL_Color color)
+{
+    SIMPLE_TEXT_TIME_DRAW;
+    draw_utf8_text(utf8_text.data(), utf8_text.size(), font_atlas, renderer, x, y, size, h_offset, target, color);
+}
 
-/**
- * Draw multiline text with typewritter.
- *
- * @param text string to be drawed.
- * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
- * @param renderer SDL_Renderer pointer to the current renderer.
- * @param rect SDL_Rect destiny reference.
- * @param target CombineTexture pointer to the texture that will store the text.
- * @param stats TypeStats reference to typewritter effect attributes.
- * @param size size of the font when drawing.
- * @param callback function that will be called when the text finishes drawing.
- * @param h_offset horizontal offset between characters in percentage.
- * @param v_offset vertical offset between characters in percentage.
- */
-void draw_typewriter(std::string &text,
-                     const FontAtlas &font_atlas,
-                     SDL_Renderer *renderer,
-                     const SDL_Rect &rect,
-                     CombinedTexture *target,
-                     TypeStats &stats,
-                     const int size,
-                     void (*callback)() = nullptr,
-                     const int h_offset = 57,
-                     const int v_offset = 70);
+void draw_utf8_text(const uint32_t *utf8_text,
+                    const size_t count,
+                    const FontAtlas &font_atlas,
+                    SDL_Renderer *renderer,
+                    const int x,
+                    const int y,
+                    const int size,
+                    const int h_offset,
+                    CombinedTexture *target,
+                    SDL_Color color)
+{
+    SIMPLE_TEXT_TIME_DRAW;
+    draw_characters(Utf32Text{utf8_text, count}, font_atlas, renderer, x, y, size, h_offset, target, color);
+}
 
 /**
- * Draw multiline text into a single texture (if provided) or into the renderer.
- *
- * @param text string to be drawed.
- * @param font_atlas FontAtlas reference containing the font atlas texture and characters.
- * @param renderer SDL_Renderer pointer to the current renderer.
- * @param rect SDL_Rect destiny reference.
- * @param size size of the font when drawing.
- * @param h_offset horizontal offset between characters in percentage.
- * @param v_offset vertical offset between characters in percentage.
- * @param target CombineTexture pointer to the texture that will store the text.
+ * Parse the number of a markup tag.
+ * @returns false if value isn't only a number
  */
-void draw_text_multiline(const std::string &text,
-                         const FontAtlas &font_atlas,
-                         SDL_Renderer *renderer,
-                         const SDL_Rect &rect,
-                         const int size,
-                         const int h_offset = 57,
-                         const int v_offset = 70,
-                         CombinedTexture *target = nullptr,
-                         std::vector<std::string> *c_lines = nullptr);
-
-bool is_utf8_start(char c)
+bool parse_markup_number(std::string_view value, float &out)
 {
-    return ((c & 0xE0) == 0xC0 || (c & 0xF0) == 0xE0 || (c & 0xF8) == 0xF0);
+    char number[16];
+    if (value.empty() || value.size() >= sizeof(number))
+        return false;
+    memcpy(number, value.data(), value.size());
+    number[value.size()] = '\0';
+    char *end = nullptr;
+    out = strtof(number, &end);
+    return end != number && *end == '\0';
 }
 
-bool is_utf_cont(char c)
+void parse_text_markup(std::string_view text,
+                       std::string &plain,
+                       std::vector<TextRun> &runs,
+                       std::vector<TypeMarker> &markers,
+                       const SDL_Color color,
+                       const int size)
 {
-    return (c & 0xC0) == 0x80;
-}
+    plain.clear();
+    runs.clear();
+    markers.clear();
 
-std::vector<uint32_t> get_utf8_char_vector(const char *text)
-{
-    std::vector<uint32_t> converted;
-    uint32_t temp_char = 0x00000000;
-    uint8_t current_offset = 0;
-    uint32_t mask;
-    for (int i = 0; i < strlen(text); i++)
+    // Styles opened by tags, closed in reverse order.
+    const int max_depth = 8;
+    SDL_Color colors[max_depth];
+    int sizes[max_depth];
+    int atlases[max_depth];
+    int color_depth = 0;
+    int size_depth = 0;
+    int atlas_depth = 0;
+    TextRun style = {0, 0, {color.r, color.g, color.b, 255}, size, 0};
+    runs.push_back(style);
+
+    auto apply_tag = [&](std::string_view tag) -> bool
     {
-        if (is_utf8_start(text[i]))
+        float number = 0.0f;
+        if (tag == "/c")
         {
-            current_offset = 0;
-            temp_char = 0x00000000;
-            if ((text[i] & 0xE0) == 0xC0)
-            {
-                temp_char = temp_char | (text[i] << 8);
-                current_offset = 0;
-                mask = 0xffff0000;
-            }
-            else if ((text[i] & 0xF0) == 0xE0)
-            {
-                temp_char = temp_char | (text[i] << 16);
-                current_offset = 1;
-                mask = 0xff000000;
-            }
-            else if ((text[i] & 0xF8) == 0xF0)
-            {
-                temp_char = temp_char | (text[i] << 24);
-                current_offset = 2;
-                mask = 0x00000000;
-            }
+            if (color_depth > 0)
+                style.color = colors[--color_depth];
+            return true;
+        }
+        if (tag == "/z")
+        {
+            if (size_depth > 0)
+                style.size = sizes[--size_depth];
+            return true;
         }
-        else if (is_utf_cont(text[i]))
+        if (tag == "/f")
         {
-            uint32_t num = 0x00000000;
-            num = text[i] << (current_offset * 8);
-            if (current_offset == 0)
-                temp_char = (temp_char | (num & 0xff0000ff));
-            if (current_offset == 1)
-                temp_char = (temp_char | (num & 0xff00ffff));
-            if (current_offset == 2)
-                temp_char = (temp_char | (num & 0xffffffff));
-            current_offset--;
-            if ((i + 1 < strlen(text) && !is_utf_cont(text[i + 1])) || (i + 1 == strlen(text)))
+            if (atlas_depth > 0)
+                style.atlas = atlases[--atlas_depth];
+            return true;
+        }
+        if (tag.size() < 3 || tag[1] != ':')
+            return false;
+        const std::string_view value = tag.substr(2);
+        switch (tag[0])
+        {
+        case 'c':
+        {
+            if (value.size() != 6)
+                return false;
+            uint32_t rgb = 0;
+            for (char h : value)
             {
-                temp_char = temp_char ^ mask;
-                converted.push_back(temp_char);
+                const int digit = h >= '0' && h <= '9' ? h - '0' : (h >= 'a' && h <= 'f' ? h - 'a' + 10 : (h >= 'A' && h <= 'F' ? h - 'A' + 10 : -1));
+                if (digit < 0)
+                    return false;
+                rgb = (rgb << 4) | digit;
             }
+            if (color_depth < max_depth)
+                colors[color_depth++] = style.color;
+            style.color = {(Uint8)(rgb >> 16), (Uint8)(rgb >> 8), (Uint8)rgb, 255};
+            return true;
         }
-        else
+        case 'z':
+            if (!parse_markup_number(value, number) || number < 1.0f || number > 1024.0f)
+                return false;
+            if (size_depth < max_depth)
+                sizes[size_depth++] = style.size;
+            style.size = (int)number;
+            return true;
+        case 'f':
+            if (!parse_markup_number(value, number) || number < 0.0f || number > 255.0f)
+                return false;
+            if (atlas_depth < max_depth)
+                atlases[atlas_depth++] = style.atlas;
+            style.atlas = (int)number;
+            return true;
+        case 's':
+            if (!parse_markup_number(value, number) || number <= 0.0f)
+                return false;
+            markers.push_back({0, plain.size(), 's', number});
+            return true;
+        case 'p':
+        case 'w':
+            if (!parse_markup_number(value, number) || number < 0.0f)
+                return false;
+            markers.push_back({0, plain.size(), 'p', number});
+            return true;
+        default:
+            return false;
+        }
+    };
+
+    size_t i = 0;
+    while (i < text.size())
+    {
+        const size_t close = text[i] == '{' ? text.find('}', i + 1) : std::string_view::npos;
+        if (close != std::string_view::npos && close - i <= 16 && apply_tag(text.substr(i + 1, close - i - 1)))
         {
-            converted.push_back((uint32_t)(text[i]));
+            // A run starts where the style changes, replacing a run with no text yet.
+            TextRun &last = runs.back();
+            const bool same = last.size == style.size && last.atlas == style.atlas &&
+                              memcmp(&last.color, &style.color, sizeof(SDL_Color)) == 0;
+            if (!same)
+            {
+                style.offset = (uint32_t)plain.size();
+                if (last.offset == style.offset && runs.size() > 1)
+                    last = style;
+                else
+                    runs.push_back(style);
+            }
+            i = close + 1;
+            continue;
         }
+        plain.push_back(text[i]);
+        i++;
     }
-    return converted;
 }
 
-int get_char_index(uint32_t character, const char *atlas)
+void build_rich_layout(TextLayout &layout,
+                       const std::string &markup,
+                       const FontAtlas *const *atlases,
+                       const int atlas_count,
+                       const int size,
+                       const int h_offset,
+                       const int v_offset,
+                       const int max_length,
+                       const SDL_Color color)
 {
-    std::vector<uint32_t> utf8_atlas = get_utf8_char_vector(atlas);
-    for (int i = 0; i < utf8_atlas.size(); i++)
+    SIMPLE_TEXT_COUNT(layout_builds, 1);
+    layout.glyphs.clear();
+    layout.line_starts.clear();
+    layout.lines.clear();
+    layout.quads.clear();
+    layout.quad_uvs.clear();
+    layout.quad_glyphs.clear();
+    layout.quad_runs.clear();
+    parse_text_markup(markup, layout.plain, layout.runs, layout.markers, color, size);
+    for (TextRun &run : layout.runs)
     {
-        if (utf8_atlas[i] == character)
-            return i; 
+        if (run.atlas >= atlas_count)
+            run.atlas = 0;
     }
-    return -1;
+
+    const std::string &text = layout.plain;
+    std::vector<LayoutGlyph> &glyphs = layout.glyphs;
+    const char *base = text.data();
+    const char *it = base;
+    const char *end = base + text.size();
+    size_t run = 0;
+    size_t marker = 0;
+
+    // Line being filled, up to the last word placed on it.
+    size_t line_first = 0;
+    uint32_t line_start = 0;
+    uint32_t line_end = 0;
+    int line_width = 0;
+    int line_y = 0;
+
+    // Word being placed, moved to a new line whole if it doesn't fit.
+    bool in_word = false;
+    size_t word_first = 0;
+    uint32_t word_start = 0;
+    int word_x = 0;
+    int pen_x = 0;
+    int previous = -1;
+    size_t previous_run = 0;
+
+    auto finish_line = [&](const size_t line_last)
+    {
+        int tallest = 0;
+        for (size_t g = line_first; g < line_last; g++)
+        {
+            if (layout.runs[glyphs[g].run].size > tallest)
+                tallest = layout.runs[glyphs[g].run].size;
+        }
+        if (tallest == 0)
+            tallest = layout.runs[run].size;
+        for (size_t g = line_first; g < line_last; g++)
+            glyphs[g].y = line_y + tallest - layout.runs[glyphs[g].run].size;
+        layout.line_starts.push_back((int)line_first);
+        layout.lines.push_back({line_start, line_end - line_start, line_width});
+        line_y += tallest * v_offset / 100;
+    };
+    auto end_word = [&](const uint32_t pos)
+    {
+        if (!in_word)
+            return;
+        in_word = false;
+        line_end = pos;
+        line_width = pen_x;
+    };
+
+    while (it < end)
+    {
+        const uint32_t pos = (uint32_t)(it - base);
+        const uint32_t c = decode_next(it, end);
+        while (run + 1 < layout.runs.size() && layout.runs[run + 1].offset <= pos)
+        {
+            run++;
+            layout.runs[run].first_glyph = (uint32_t)glyphs.size();
+        }
+        const TextRun &style = layout.runs[run];
+        const FontAtlas &atlas = *atlases[style.atlas];
+
+        if (c == '\n')
+        {
+            end_word(pos);
+            finish_line(glyphs.size());
+            line_first = glyphs.size();
+            line_start = (uint32_t)(it - base);
+            line_end = line_start;
+            line_width = 0;
+            pen_x = 0;
+            previous = -1;
+            continue;
+        }
+        if (c == ' ' || c == '\t')
+        {
+            end_word(pos);
+            previous = -1;
+            if (c == '\t')
+                continue;
+            while (marker < layout.markers.size() && layout.markers[marker].offset <= pos)
+                layout.markers[marker++].glyph = (int)glyphs.size();
+            glyphs.push_back({c, -1, pen_x, 0, 0, (uint16_t)run});
+            pen_x += atlas.glyph_advance(-1, style.size, h_offset);
+            continue;
+        }
+        if (c == '\r')
+            continue;
+        const int index = atlas.glyph_index(c);
+        if (index == -1)
+            continue;
+
+        if (!in_word)
+        {
+            in_word = true;
+            word_first = glyphs.size();
+            word_start = pos;
+            word_x = pen_x;
+        }
+        const TextRun &last_style = layout.runs[previous_run];
+        if (previous != -1 && last_style.atlas == style.atlas && last_style.size == style.size)
+            pen_x += atlas.kerning(previous, index, style.size);
+        while (marker < layout.markers.size() && layout.markers[marker].offset <= pos)
+            layout.markers[marker++].glyph = (int)glyphs.size();
+        glyphs.push_back({c, index, pen_x, 0, 0, (uint16_t)run});
+        pen_x += atlas.glyph_advance(index, style.size, h_offset);
+        previous = index;
+        previous_run = run;
+
+        if (pen_x > max_length && word_x > 0 && line_end > line_start)
+        {
+            // The word goes to a new line, the spaces before it stay on the old one.
+            finish_line(word_first);
+            line_first = word_first;
+            line_start = word_start;
+            line_end = word_start;
+            line_width = 0;
+            for (size_t g = word_first; g < glyphs.size(); g++)
+                glyphs[g].x -= word_x;
+            pen_x -= word_x;
+            word_x = 0;
+        }
+    }
+    end_word((uint32_t)text.size());
+    if (glyphs.size() > line_first)
+        finish_line(glyphs.size());
+    for (; marker < layout.markers.size(); marker++)
+        layout.markers[marker].glyph = (int)glyphs.size();
+
+    for (LayoutGlyph &g : glyphs)
+    {
+        g.quad = (int)layout.quads.size();
+        if (g.index == -1)
+            continue;
+        const TextRun &style = layout.runs[g.run];
+        const FontAtlas &atlas = *atlases[style.atlas];
+        const SDL_Rect box = atlas.glyph_destiny(g.index, g.x, g.y, style.size);
+        const SDL_FRect &uv = atlas.glyph_uvs[g.index];
+        layout.quads.push_back({(float)box.x, (float)box.y, (float)(box.x + box.w), (float)(box.y + box.h)});
+        layout.quad_uvs.push_back({uv.x, uv.y, uv.x + uv.w, uv.y + uv.h});
+        layout.quad_glyphs.push_back(g.index);
+        layout.quad_runs.push_back(g.run);
+    }
+
+    layout.text_data = markup.data();
+    layout.text_size = markup.size();
+    layout.size = size;
+    layout.h_offset = h_offset;
+    layout.v_offset = v_offset;
+    layout.max_width = max_length;
+    layout.valid = true;
 }
 
-SDL_Rect get_atlas_rect_by_index(const int index, const int atlas_width, const int atlas_height, const int cell_width, const int cell_height)
+void build_rich_layout(TextLayout &layout,
+                       const std::string &markup,
+                       const FontAtlas &font_atlas,
+                       const int size,
+                       const int h_offset,
+                       const int v_offset,
+                       const int max_length,
+                       const SDL_Color color)
 {
-    SDL_Rect rect;
-    int cells_per_row = atlas_width / cell_width;
+    const FontAtlas *atlases[1] = {&font_atlas};
+    build_rich_layout(layout, markup, atlases, 1, size, h_offset, v_offset, max_length, color);
+}
 
-    int row = index / cells_per_row;
-    int col = index % cells_per_row;
+void draw_rich_layout(const TextLayout &layout,
+                      const FontAtlas *const *atlases,
+                      const int atlas_count,
+                      TextBatch &batch,
+                      const int x,
+                      const int y,
+                      const size_t first,
+                      size_t count,
+                      const TextEffect *effect)
+{
+    SIMPLE_TEXT_TIME_DRAW;
+    if (first >= layout.glyphs.size() || atlas_count < 1)
+        return;
+    if (count > layout.glyphs.size() - first)
+        count = layout.glyphs.size() - first;
+    size_t begin = layout.glyphs[first].quad;
+    const size_t end = first + count < layout.glyphs.size() ? layout.glyphs[first + count].quad : layout.quads.size();
+    const bool styled = layout.quad_runs.size() == layout.quads.size() && !layout.runs.empty();
+    for (int i = 0; i < atlas_count; i++)
+        batch.distance_field |= atlases[i]->pixel_format == ATLAS_PIXELS_SDF;
+    if (effect)
+        batch.begin_effect();
 
-    rect.x = col * cell_width;
-    rect.y = row * cell_height;
-    rect.w = cell_width;
-    rect.h = cell_height;
+    // Quads of the same run and atlas page are written together, runs of the
+    // same page land in the same bucket and go out in one draw.
+    while (begin < end)
+    {
+        const int run = styled ? layout.quad_runs[begin] : -1;
+        const TextRun *style = styled ? &layout.runs[run] : nullptr;
+        const FontAtlas &atlas = *atlases[style && style->atlas < atlas_count ? style->atlas : 0];
+        const int page = atlas.glyph_page(layout.quad_glyphs[begin]);
+        size_t next = begin + 1;
+        while (next < end && (styled ? layout.quad_runs[next] : -1) == run && atlas.glyph_page(layout.quad_glyphs[next]) == page)
+            next++;
+        const SDL_Color color = style ? style->color : SDL_Color{255, 255, 255, 255};
+        SDL_Vertex *out = batch.reserve_quads(atlas.glyph_texture(layout.quad_glyphs[begin]), next - begin);
+        build_quad_vertices(layout.quads.data() + begin, layout.quad_uvs.data() + begin, next - begin, (float)x, (float)y, color, out);
+        begin = next;
+    }
+    if (effect)
+        batch.apply_effect(*effect);
+}
 
-    return rect;
+void draw_rich_layout(const TextLayout &layout,
+                      const FontAtlas &font_atlas,
+                      TextBatch &batch,
+                      const int x,
+                      const int y,
+                      const size_t first,
+                      size_t count,
+                      const TextEffect *effect)
+{
+    const FontAtlas *atlases[1] = {&font_atlas};
+    draw_rich_layout(layout, atlases, 1, batch, x, y, first, count, effect);
 }
 
-std::string remove_new_lines(const std::string &input_string)
+void draw_typewriter(const std::string &text,
+                         const FontAtlas &font_atlas,
+                         SDL_Renderer *renderer,
+                         const SDL_Rect &rect,
+                         CombinedTexture *target,
+                         TypeStats &stats,
+                         const int size,
+                         void (*callback)(),
+                         const int h_offset,
+                         const int v_offset)
 {
-    std::string result = input_string;
-    size_t found = result.find('\n');
-    while (found != std::string::npos)
+    SIMPLE_TEXT_TIME_DRAW;
+    // Over budget, the frame shows what is already typed and the timer keeps the time for the next one.
+    if (!text_budget_left())
     {
-        result.erase(found, 1);
-        found = result.find('\n');
+        end_target_draw(target, renderer);
+        return;
     }
-    return result;
-}
+    TextBudgetTimer budget;
+    const std::vector<TypeMarker> &markers = stats.layout.markers;
+    if (!stats.layout.matches(text, size, h_offset, v_offset, rect.w))
+    {
+        build_rich_layout(stats.layout, text, font_atlas, size, h_offset, v_offset, rect.w);
 
-std::vector<std::string> split_string_by_newline(const std::string &input_string)
-{
-    std::vector<std::string> result;
-    std::istringstream iss(input_string);
+        // Keep the speed of the markers already typed.
+        stats.speed = 1.0f;
+        stats.next_marker = 0;
+        while (stats.next_marker < markers.size() && markers[stats.next_marker].glyph < stats.type_counter)
+        {
+            if (markers[stats.next_marker].kind == 's')
+                stats.speed = markers[stats.next_marker].value;
+            stats.next_marker++;
+        }
+    }
 
-    std::string line;
-    while (std::getline(iss, line, u8'\n'))
+    // Spend the accumulated time on as many glyphs as it pays for, keeping the rest.
+    const int total = (int)stats.layout.glyphs.size();
+    int reveal = stats.type_counter;
+    if (stats.skipping)
+    {
+        reveal = total;
+        stats.next_marker = markers.size();
+        stats.skipping = false;
+    }
+    while (reveal < total)
     {
-        result.push_back(remove_new_lines(line));
+        while (stats.next_marker < markers.size() && markers[stats.next_marker].glyph <= reveal)
+        {
+            const TypeMarker &m = markers[stats.next_marker++];
+            if (m.kind == 's')
+                stats.speed = m.value;
+            else
+                stats.timer -= m.value;
+        }
+        const float cost = stats.duration / stats.speed;
+        if (stats.timer < cost)
+            break;
+        stats.timer -= cost;
+        reveal++;
     }
 
-    return result;
+    if (reveal > stats.type_counter)
+    {
+        // Every glyph revealed this frame goes in one render target pass.
+        target->finished = false;
+        begin_target_draw(target, renderer, rect);
+        draw_rich_layout(stats.layout, font_atlas, stats.batch, rect.x - target->area.x, rect.y - target->area.y,
+                         stats.type_counter, reveal - stats.type_counter, stats.effect);
+        stats.batch.flush(renderer);
+        target->finished = true;
+
+        const LayoutGlyph &g = stats.layout.glyphs[reveal - 1];
+        stats.current_x = rect.x + g.x + (size - (h_offset * size / 100));
+        stats.type_counter = reveal;
+        if (stats.type_counter == total)
+        {
+            stats.timer = 0;
+            if (callback != nullptr)
+                callback();
+        }
+    }
+    end_target_draw(target, renderer);
 }
 
-std::vector<std::string> split_text_by_size(const std::string &text, const int size, const int h_offset, const int max_length)
+void draw_text_multiline(std::string_view text,
+                         const FontAtlas &font_atlas,
+                         SDL_Renderer *renderer,
+                         const SDL_Rect &rect,
+                         const int size,
+                         const int h_offset,
+                         const int v_offset,
+                         CombinedTexture *target,
+                         std::vector<std::string> *c_lines)
 {
-    std::vector<std::string> result;
-
-    std::istringstream iss(text);
-    std::string word;
-
-    int real_offset = size - (size * h_offset / 100);
-
-    while (iss >> word)
+    SIMPLE_TEXT_TIME_DRAW;
+    int origin_x = rect.x;
+    int current_y = rect.y;
+    if (target)
     {
-        if (result.empty())
+        if (!begin_target_draw(target, renderer, rect))
         {
-            result.push_back(word);
+            end_target_draw(target, renderer);
+            return;
         }
-        else
+        origin_x -= target->area.x;
+        current_y -= target->area.y;
+    }
+
+    if (c_lines)
+    {
+        for (const auto &l : *c_lines)
         {
-            std::string &lastElement = result.back();
-            if ((lastElement.length() * real_offset) + (word.length() * real_offset) + real_offset <= max_length)
-            {
-                lastElement += " " + word;
-            }
-            else
-            {
-                result.push_back(word);
-            }
+            draw_glyph_run(Utf8Text(l), font_atlas, renderer, origin_x, current_y, size, h_offset);
+            current_y += (size * v_offset / 100);
         }
     }
+    else
+    {
+        wrap_text_each(text, &font_atlas, size, h_offset, rect.w, [&](const LineSpan &span)
+                       {
+                           draw_glyph_run(Utf8Text(text.substr(span.offset, span.length)), font_atlas, renderer, origin_x, current_y, size, h_offset);
+                           current_y += (size * v_offset / 100); });
+    }
 
-    return result;
+    if (target)
+    {
+        target->finished = true;
+        end_target_draw(target, renderer);
+    }
 }
 
-std::vector<std::string> get_all_lines(const std::string &text, const int size, const int h_offset, const int max_length)
+void draw_text_batched(std::string_view text,
+                       const FontAtlas &font_atlas,
+                       TextBatch &batch,
+                       const int x,
+                       const int y,
+                       const int size,
+                       const int h_offset,
+                       SDL_Color color,
+                       const TextEffect *effect)
 {
-    std::vector<std::string> result;
-    std::vector<std::string> temp = split_string_by_newline(text);
-    for(auto t : temp)
+    SIMPLE_TEXT_TIME_DRAW;
+    // The color is RGB only, glyph coverage comes from the atlas alpha.
+    color.a = 255;
+    batch.distance_field |= font_atlas.pixel_format == ATLAS_PIXELS_SDF;
+    if (effect)
+        batch.begin_effect();
+    int current_x = x;
+    int previous = -1;
+    for (auto c : Utf8Text(text))
     {
-        std::vector<std::string> splt = split_text_by_size(t, size, h_offset, max_length);
-        for(auto s : splt)
+        const int index = c == ' ' ? -1 : font_atlas.glyph_index(c);
+        if (c != ' ' && index == -1)
+            continue;
+        current_x += font_atlas.kerning(previous, index, size);
+        if (index != -1)
         {
-            result.push_back(s);
+            SDL_Rect destiny = font_atlas.glyph_destiny(index, current_x, y, size);
+            batch.add_quad(font_atlas.glyph_texture(index), font_atlas.glyph_uvs[index], destiny, color);
         }
+        current_x += font_atlas.glyph_advance(index, size, h_offset);
+        previous = index;
     }
-    return result;
+    if (effect)
+        batch.apply_effect(*effect);
 }
 
-int get_current_line(const std::vector<std::string> &lines, const int current_char)
+void draw_text_batched(std::string_view text,
+                       const FontAtlas &font_atlas,
+                       SDL_Renderer *renderer,
+                       const int x,
+                       const int y,
+                       const int size,
+                       const int h_offset,
+                       SDL_Color color,
+                       const TextEffect *effect)
 {
-    int total_chars = 0;
+    SIMPLE_TEXT_TIME_DRAW;
+#if defined(__psp__) && defined(SIMPLE_TEXT_GU)
+    // The GE path draws a single color, effects go through SDL.
+    if (effect == nullptr && gu_draw_text(text, font_atlas, renderer, x, y, size, h_offset, color))
+        return;
+#endif
+    static TextBatch batch;
+    draw_text_batched(text, font_atlas, batch, x, y, size, h_offset, color, effect);
+    batch.flush(renderer);
+}
 
-    for (int i = 0; i < lines.size(); i++)
-    {
-        std::vector<uint32_t> utf8_line = get_utf8_char_vector(lines[i].c_str());
-        total_chars += utf8_line.size() + 1;
+void raster_quad(TextCanvas &canvas, const SDL_Surface *image, const GlyphQuad &box, const GlyphQuad &uv, const SDL_Color color)
+{
+    if (image == nullptr || canvas.pixels == nullptr || box.x1 <= box.x0 || box.y1 <= box.y0)
+        return;
+    // Pixels whose center is inside the box, clipped to the canvas.
+    int x0 = (int)ceilf(box.x0 - 0.5f);
+    int y0 = (int)ceilf(box.y0 - 0.5f);
+    int x1 = (int)ceilf(box.x1 - 0.5f);
+    int y1 = (int)ceilf(box.y1 - 0.5f);
+    if (x0 < 0)
+        x0 = 0;
+    if (y0 < 0)
+        y0 = 0;
+    if (x1 > canvas.width)
+        x1 = canvas.width;
+    if (y1 > canvas.height)
+        y1 = canvas.height;
 
-        if (total_chars > current_char)
+    const float du = (uv.x1 - uv.x0) / (box.x1 - box.x0);
+    const float dv = (uv.y1 - uv.y0) / (box.y1 - box.y0);
+    for (int y = y0; y < y1; y++)
+    {
+        int ty = (int)((uv.y0 + (y + 0.5f - box.y0) * dv) * image->h);
+        ty = ty < 0 ? 0 : (ty >= image->h ? image->h - 1 : ty);
+        const uint8_t *source = (const uint8_t *)image->pixels + (size_t)ty * image->pitch;
+        uint8_t *out = canvas.pixels + (size_t)y * canvas.pitch;
+        for (int x = x0; x < x1; x++)
         {
-            return i;
+            int tx = (int)((uv.x0 + (x + 0.5f - box.x0) * du) * image->w);
+            tx = tx < 0 ? 0 : (tx >= image->w ? image->w - 1 : tx);
+            const uint8_t *texel = source + tx * 4;
+            const int alpha = texel[3] * color.a / 255;
+            if (alpha == 0)
+                continue;
+            uint8_t *pixel = out + x * 4;
+            pixel[0] = (uint8_t)((texel[0] * color.r / 255 * alpha + pixel[0] * (255 - alpha)) / 255);
+            pixel[1] = (uint8_t)((texel[1] * color.g / 255 * alpha + pixel[1] * (255 - alpha)) / 255);
+            pixel[2] = (uint8_t)((texel[2] * color.b / 255 * alpha + pixel[2] * (255 - alpha)) / 255);
+            pixel[3] = (uint8_t)(alpha + pixel[3] * (255 - alpha) / 255);
         }
     }
-    return -1;
 }
 
-void draw_text(const std::string &text,
-               const FontAtlas &font_atlas,
-               SDL_Renderer *renderer,
-               const int x,
-               const int y,
-               const int size,
-               const int h_offset,
-               CombinedTexture *target,
-               SDL_Color color)
+void raster_batch(TextCanvas &canvas, const TextBatch &batch, const FontAtlas &font_atlas)
 {
-    if (target && target->texture == nullptr)
+    SIMPLE_TEXT_TIME_DRAW;
+    for (size_t i = 0; i < batch.used_buckets; i++)
     {
-        int w, h;
-        SDL_GetRendererOutputSize(renderer, &w, &h);
-        target->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
-        SDL_SetRenderTarget(renderer, target->texture);
-        SDL_SetTextureBlendMode(target->texture, SDL_BLENDMODE_BLEND);
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-        SDL_RenderClear(renderer);
-    }
-    if (target && target->finished)
-    {
-        if (SDL_GetRenderTarget(renderer) != nullptr)
+        const TextBatch::Bucket &b = batch.buckets[i];
+        SIMPLE_TEXT_COUNT(glyphs_drawn, b.indices.size() / 6);
+        for (size_t q = 0; q + 6 <= b.indices.size(); q += 6)
         {
-            SDL_SetRenderTarget(renderer, nullptr);
+            // Quads are written in the add_quad order: top left, top right, bottom right, bottom left.
+            const SDL_Vertex &a = b.vertices[b.indices[q]];
+            const SDL_Vertex &c = b.vertices[b.indices[q + 2]];
+            const GlyphQuad box = {a.position.x, a.position.y, c.position.x, c.position.y};
+            const GlyphQuad uv = {a.tex_coord.x, a.tex_coord.y, c.tex_coord.x, c.tex_coord.y};
+            raster_quad(canvas, font_atlas.headless_image, box, uv, a.color);
         }
-        SDL_RenderCopy(renderer, target->texture, nullptr, nullptr);
-        return;
     }
+}
+
+/**
+ * Blend one glyph of a headless atlas into a canvas.
+ */
+void raster_glyph(TextCanvas &canvas, const FontAtlas &font_atlas, const int index, const SDL_Rect &destiny, const SDL_Color color)
+{
+    const SDL_FRect &uv = font_atlas.glyph_uvs[index];
+    const GlyphQuad box = {(float)destiny.x, (float)destiny.y, (float)(destiny.x + destiny.w), (float)(destiny.y + destiny.h)};
+    SIMPLE_TEXT_COUNT(glyphs_drawn, 1);
+    raster_quad(canvas, font_atlas.headless_image, box, {uv.x, uv.y, uv.x + uv.w, uv.y + uv.h}, color);
+}
+
+void raster_text(std::string_view text,
+                 const FontAtlas &font_atlas,
+                 TextCanvas &canvas,
+                 const int x,
+                 const int y,
+                 const int size,
+                 const int h_offset,
+                 SDL_Color color)
+{
+    SIMPLE_TEXT_TIME_DRAW;
+    color.a = 255;
     int current_x = x;
-    std::vector<uint32_t> utf8_text = get_utf8_char_vector(text.c_str());
-    for (auto c : utf8_text)
+    int previous = -1;
+    for (auto c : Utf8Text(text))
     {
-        if (c == ' ')
-        {
-            current_x += (size - (h_offset * size / 100));
-            if (target)
-            {
-                if (SDL_GetRenderTarget(renderer) != nullptr)
-                {
-                    SDL_SetRenderTarget(renderer, nullptr);
-                }
-                SDL_RenderCopy(renderer, target->texture, nullptr, nullptr);
-            }
+        const int index = c == ' ' ? -1 : font_atlas.glyph_index(c);
+        if (c != ' ' && index == -1)
             continue;
-        }
-        const int index = get_char_index(c, font_atlas.characters);
+        current_x += font_atlas.kerning(previous, index, size);
         if (index != -1)
-        {
-            SDL_Rect source;
-            SDL_Rect src = get_atlas_rect_by_index(index, 512, 512, 32, 32);
-            source.x = src.x;
-            source.y = src.y;
-            source.w = src.w;
-            source.h = src.h;
-            SDL_Rect destiny = {current_x, y, size, size};
-            current_x += (size - (h_offset * size / 100));
-
-            if (target)
-            {
-                int w, h;
-                SDL_GetRendererOutputSize(renderer, &w, &h);
-                SDL_Texture *tmp_target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
-
-                SDL_SetRenderTarget(renderer, tmp_target);
-                SDL_SetTextureBlendMode(tmp_target, SDL_BLENDMODE_BLEND);
-                SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-                SDL_RenderClear(renderer);
-                SDL_SetTextureColorMod(tmp_target, color.r, color.g, color.b);
-                SDL_RenderCopy(renderer, font_atlas.atlas_texture, &source, &destiny);
-
-                SDL_SetRenderTarget(renderer, target->texture);
-                SDL_RenderCopy(renderer, tmp_target, nullptr, nullptr);
-                SDL_SetRenderTarget(renderer, nullptr);
-                SDL_RenderCopy(renderer, target->texture, nullptr, nullptr);
-                SDL_DestroyTexture(tmp_target);
-                tmp_target = nullptr;
-            }
-            else
-            {
-                SDL_RenderCopy(renderer, font_atlas.atlas_texture, &source, &destiny);
-            }
-        }
-        else
-        {
-            if (target)
-            {
-                if (SDL_GetRenderTarget(renderer) != nullptr)
-                {
-                    SDL_SetRenderTarget(renderer, nullptr);
-                }
-                SDL_RenderCopy(renderer, target->texture, nullptr, nullptr);
-            }
-        }
+            raster_glyph(canvas, font_atlas, index, font_atlas.glyph_destiny(index, current_x, y, size), color);
+        current_x += font_atlas.glyph_advance(index, size, h_offset);
+        previous = index;
     }
-    if (target)
+}
+
+void raster_text_layout(const TextLayout &layout,
+                        const FontAtlas &font_atlas,
+                        TextCanvas &canvas,
+                        const int x,
+                        const int y,
+                        const size_t first,
+                        size_t count,
+                        SDL_Color color)
+{
+    SIMPLE_TEXT_TIME_DRAW;
+    if (first >= layout.glyphs.size())
+        return;
+    if (count > layout.glyphs.size() - first)
+        count = layout.glyphs.size() - first;
+    color.a = 255;
+    for (size_t i = first; i < first + count; i++)
     {
-        if (SDL_GetRenderTarget(renderer) != nullptr)
-        {
-            SDL_SetRenderTarget(renderer, nullptr);
-        }
-        target->finished = true;
+        const LayoutGlyph &g = layout.glyphs[i];
+        if (g.index != -1)
+            raster_glyph(canvas, font_atlas, g.index, font_atlas.glyph_destiny(g.index, x + g.x, y + g.y, layout.size), color);
     }
 }
 
-void draw_utf8_text(const std::vector<uint32_t> utf8_text,
-                    const FontAtlas &font_atlas,
-                    SDL_Renderer *renderer,
-                    const int x,
-                    const int y,
-                    const int size,
-                    const int h_offset,
-                    CombinedTexture *target,
-                    SDL_Color color)
+uint32_t text_hash(std::string_view text)
 {
-    if (target && target->texture == nullptr)
+    uint32_t hash = 2166136261u;
+    for (char c : text)
     {
-        int w, h;
-        SDL_GetRendererOutputSize(renderer, &w, &h);
-        target->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
-        SDL_SetRenderTarget(renderer, target->texture);
-        SDL_SetTextureBlendMode(target->texture, SDL_BLENDMODE_BLEND);
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-        SDL_RenderClear(renderer);
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
     }
-    if (target && target->finished)
+    return hash;
+}
+
+/**
+ * Find or build the TextCache entry of a text, then draw it.
+ * max_width is -1 for a single line, or the wrap width of a multiline text.
+ */
+void draw_cached(TextCache &cache,
+                 std::string_view text,
+                 const FontAtlas &font_atlas,
+                 SDL_Renderer *renderer,
+                 const int x,
+                 const int y,
+                 const int size,
+                 const int h_offset,
+                 const int v_offset,
+                 const int max_width,
+                 const int max_height,
+                 SDL_Color color)
+{
+    SIMPLE_TEXT_TIME_DRAW;
+    color.a = 255;
+    uint32_t key = text_hash(text);
+    key = (key ^ (uint32_t)size) * 16777619u;
+    key = (key ^ (uint32_t)h_offset) * 16777619u;
+    key = (key ^ (uint32_t)v_offset) * 16777619u;
+    key = (key ^ (uint32_t)max_width) * 16777619u;
+    key = (key ^ ((uint32_t)color.r << 16 | (uint32_t)color.g << 8 | color.b)) * 16777619u;
+    key = (key ^ (uint32_t)(uintptr_t)&font_atlas) * 16777619u;
+
+    TextCache::Entry *entry = cache.find(key, text, &font_atlas, size, h_offset, v_offset, max_width, color);
+    if (entry == nullptr)
     {
-        if (SDL_GetRenderTarget(renderer) != nullptr)
+        cache.entries.emplace_back();
+        entry = &cache.entries.back();
+        entry->key = key;
+        entry->text = std::string(text);
+        entry->atlas = &font_atlas;
+        entry->size = size;
+        entry->h_offset = h_offset;
+        entry->v_offset = v_offset;
+        entry->max_width = max_width;
+        entry->color = color;
+        entry->last_used = ++cache.tick;
+        entry->origin_x = x;
+        entry->origin_y = y;
+
+        const std::string_view stored(entry->text);
+        auto each_line = [&](auto line)
         {
-            SDL_SetRenderTarget(renderer, nullptr);
-        }
-        SDL_RenderCopy(renderer, target->texture, nullptr, nullptr);
-        return;
-    }
-    int current_x = x;
-    for (auto c : utf8_text)
-    {
-        if (c == ' ')
+            if (max_width >= 0)
+                wrap_text_each(stored, &font_atlas, size, h_offset, max_width, line);
+            else
+                line(LineSpan{0, (uint32_t)stored.size(), 0});
+        };
+        if (cache.mode == TEXT_CACHE_VERTICES)
         {
-            current_x += (size - (h_offset * size / 100));
-            if (target)
+            int current_y = y;
+            each_line([&](const LineSpan &span)
             {
-                if (SDL_GetRenderTarget(renderer) != nullptr)
+                int current_x = x;
+                int previous = -1;
+                for (auto c : Utf8Text(stored.substr(span.offset, span.length)))
                 {
-                    SDL_SetRenderTarget(renderer, nullptr);
+                    const int index = c == ' ' ? -1 : font_atlas.glyph_index(c);
+                    if (c != ' ' && index == -1)
+                        continue;
+                    current_x += font_atlas.kerning(previous, index, size);
+                    if (index != -1)
+                    {
+                        SDL_Rect destiny = font_atlas.glyph_destiny(index, current_x, current_y, size);
+                        entry->batch.add_quad(font_atlas.glyph_texture(index), font_atlas.glyph_uvs[index], destiny, color);
+                    }
+                    current_x += font_atlas.glyph_advance(index, size, h_offset);
+                    previous = index;
                 }
-                SDL_RenderCopy(renderer, target->texture, nullptr, nullptr);
-            }
-            continue;
-        }
-        const int index = get_char_index(c, font_atlas.characters);
-        if (index != -1)
-        {
-            SDL_Rect source;
-            SDL_Rect src = get_atlas_rect_by_index(index, 512, 512, 32, 32);
-            source.x = src.x;
-            source.y = src.y;
-            source.w = src.w;
-            source.h = src.h;
-            SDL_Rect destiny = {current_x, y, size, size};
-            current_x += (size - (h_offset * size / 100));
-
-            if (target)
-            {
-                int w, h;
-                SDL_GetRendererOutputSize(renderer, &w, &h);
-                SDL_Texture *tmp_target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
-
-                SDL_SetRenderTarget(renderer, tmp_target);
-                SDL_SetTextureBlendMode(tmp_target, SDL_BLENDMODE_BLEND);
-                SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-                SDL_RenderClear(renderer);
-                SDL_SetTextureColorMod(tmp_target, color.r, color.g, color.b);
-                SDL_RenderCopy(renderer, font_atlas.atlas_texture, &source, &destiny);
-
-                SDL_SetRenderTarget(renderer, target->texture);
-                SDL_RenderCopy(renderer, tmp_target, nullptr, nullptr);
-                SDL_SetRenderTarget(renderer, nullptr);
-                SDL_RenderCopy(renderer, target->texture, nullptr, nullptr);
-                SDL_DestroyTexture(tmp_target);
-                tmp_target = nullptr;
-            }
-            else
-            {
-                SDL_RenderCopy(renderer, font_atlas.atlas_texture, &source, &destiny);
-            }
+                current_y += (size * v_offset / 100);
+            });
+            entry->bytes = entry->batch.bytes() + entry->text.capacity();
         }
         else
         {
-            if (target)
+            if (max_width >= 0)
+                entry->area = {0, 0, max_width, max_height};
+            else
+                entry->area = glyph_run_bounds(Utf8Text(stored), font_atlas, 0, 0, size, h_offset);
+            if (entry->area.w < 1)
+                entry->area.w = 1;
+            if (entry->area.h < 1)
+                entry->area.h = 1;
+
+            SIMPLE_TEXT_COUNT(texture_creates, 1);
+            entry->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, entry->area.w, entry->area.h);
+            SIMPLE_TEXT_COUNT(target_switches, 1);
+            SDL_SetRenderTarget(renderer, entry->texture);
+            SDL_SetTextureBlendMode(entry->texture, SDL_BLENDMODE_BLEND);
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+            SDL_RenderClear(renderer);
+
+            const SDL_Color previous = font_atlas.set_color_mod(color);
+            int current_y = -entry->area.y;
+            each_line([&](const LineSpan &span)
             {
-                if (SDL_GetRenderTarget(renderer) != nullptr)
-                {
-                    SDL_SetRenderTarget(renderer, nullptr);
-                }
-                SDL_RenderCopy(renderer, target->texture, nullptr, nullptr);
-            }
+                draw_glyph_run(Utf8Text(stored.substr(span.offset, span.length)), font_atlas, renderer, -entry->area.x, current_y, size, h_offset);
+                current_y += (size * v_offset / 100);
+            });
+            font_atlas.set_color_mod(previous);
+            SIMPLE_TEXT_COUNT(target_switches, 1);
+            SDL_SetRenderTarget(renderer, nullptr);
+            entry->bytes = (size_t)entry->area.w * entry->area.h * 4;
         }
+
+        // Pages evicted while building can't be used by this entry, they weren't used this frame.
+        entry->generation = font_atlas.page_generation;
+        cache.used += entry->bytes;
+        cache.trim();
+        // Trimming may have moved the new entry.
+        entry = cache.find(key, text, &font_atlas, size, h_offset, v_offset, max_width, color);
     }
-    if (target)
+
+    if (cache.mode == TEXT_CACHE_VERTICES)
     {
-        if (SDL_GetRenderTarget(renderer) != nullptr)
+        if (entry->origin_x != x || entry->origin_y != y)
         {
-            SDL_SetRenderTarget(renderer, nullptr);
+            entry->batch.translate((float)(x - entry->origin_x), (float)(y - entry->origin_y));
+            entry->origin_x = x;
+            entry->origin_y = y;
         }
-        target->finished = true;
+        entry->batch.draw(renderer);
+    }
+    else
+    {
+        SDL_Rect destiny = {x + entry->area.x, y + entry->area.y, entry->area.w, entry->area.h};
+        SIMPLE_TEXT_COUNT(render_copies, 1);
+        SDL_RenderCopy(renderer, entry->texture, nullptr, &destiny);
     }
 }
 
-void draw_typewriter(std::string &text,
-                         const FontAtlas &font_atlas,
-                         SDL_Renderer *renderer,
-                         const SDL_Rect &rect,
-                         CombinedTexture *target,
-                         TypeStats &stats,
-                         const int size,
-                         void (*callback)(),
-                         const int h_offset,
-                         const int v_offset)
+void draw_text_cached(TextCache &cache,
+                      std::string_view text,
+                      const FontAtlas &font_atlas,
+                      SDL_Renderer *renderer,
+                      const int x,
+                      const int y,
+                      const int size,
+                      const int h_offset,
+                      SDL_Color color)
+{
+    draw_cached(cache, text, font_atlas, renderer, x, y, size, h_offset, 0, -1, 0, color);
+}
+
+void draw_text_multiline_cached(TextCache &cache,
+                                std::string_view text,
+                                const FontAtlas &font_atlas,
+                                SDL_Renderer *renderer,
+                                const SDL_Rect &rect,
+                                const int size,
+                                const int h_offset,
+                                const int v_offset,
+                                SDL_Color color)
+{
+    draw_cached(cache, text, font_atlas, renderer, rect.x, rect.y, size, h_offset, v_offset, rect.w, rect.h, color);
+}
+void text_frame_begin()
+{
+    text_frame_index++;
+    text_frame_arena.reset();
+    text_frame_spent_ns = 0;
+#ifdef SIMPLE_TEXT_STATS
+    text_stats_last = text_stats_current;
+    text_stats_current = {};
+#endif
+#ifdef SIMPLE_TEXT_COUNT_ALLOCS
+    text_frame_arena.frame_allocations = text_heap_allocations;
+#endif
+}
+
+size_t text_frame_end()
 {
-    std::vector<std::string> lines = get_all_lines(text, size, h_offset, rect.w);
-    std::string tmptext = remove_new_lines(text);
+    size_t allocations = 0;
+#ifdef SIMPLE_TEXT_COUNT_ALLOCS
+    allocations = text_heap_allocations - text_frame_arena.frame_allocations;
+    SDL_assert(allocations == 0 || text_frame_arena.warmup > 0);
+#endif
+    if (text_frame_arena.warmup > 0)
+        text_frame_arena.warmup--;
+    return allocations;
+}
 
-    if(stats.utf8_text.size() == 0)
+std::string_view text_frame_format(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    va_list measure;
+    va_copy(measure, args);
+    const int length = vsnprintf(nullptr, 0, format, measure);
+    va_end(measure);
+    char *text = length < 0 ? nullptr : text_frame_alloc<char>(length + 1);
+    if (text == nullptr)
     {
-        stats.utf8_text = get_utf8_char_vector(tmptext.c_str());
+        va_end(args);
+        return std::string_view();
     }
+    vsnprintf(text, length + 1, format, args);
+    va_end(args);
+    return std::string_view(text, length);
+}
 
-    if (stats.type_counter > stats.utf8_text.size() - 1)
+#ifdef SIMPLE_TEXT_STATS
+TextStats text_stats_snapshot()
+{
+    return text_stats_last;
+}
+
+void draw_text_stats(const FontAtlas &font_atlas,
+                     SDL_Renderer *renderer,
+                     const int x,
+                     const int y,
+                     const int size,
+                     SDL_Color color)
+{
+    const TextStats &t = text_stats_last;
+    char lines[4][80];
+    snprintf(lines[0], sizeof(lines[0]), "copies %u geometry %u targets %u", t.render_copies, t.geometry_draws, t.target_switches);
+    snprintf(lines[1], sizeof(lines[1]), "textures +%u -%u glyphs %u", t.texture_creates, t.texture_destroys, t.glyphs_drawn);
+    snprintf(lines[2], sizeof(lines[2]), "lookups %u layouts %u bytes %u", t.glyph_lookups, t.layout_builds, (unsigned)t.bytes_allocated);
+    snprintf(lines[3], sizeof(lines[3]), "decode %.2f wrap %.2f draw %.2f ms", t.decode_ns / 1000000.0, t.wrap_ns / 1000000.0, t.draw_ns / 1000000.0);
+    const SDL_Color previous = font_atlas.set_color_mod(color);
+    for (int i = 0; i < 4; i++)
     {
-        if (SDL_GetRenderTarget(renderer) != nullptr)
-        {
-            SDL_SetRenderTarget(renderer, nullptr);
-        }
-        SDL_RenderCopy(renderer, target->texture, nullptr, nullptr);
-        return;
+        draw_text(lines[i], font_atlas, renderer, x, y + i * size, size);
     }
-    if(stats.timer > stats.duration)
-    {
-        int current_line = get_current_line(lines, stats.type_counter);
-        if(stats.type_counter > 0 && current_line > get_current_line(lines, stats.type_counter - 1))
-        {
-            stats.current_x = rect.x;
-        }
-        if (get_char_index(stats.utf8_text[stats.type_counter], font_atlas.characters) == -1 && stats.utf8_text[stats.type_counter] != get_utf8_char_vector("  ")[0])
-        {
-            stats.type_counter++;
-            if (SDL_GetRenderTarget(renderer) != nullptr)
-            {
-                SDL_SetRenderTarget(renderer, nullptr);
-            }
-            SDL_RenderCopy(renderer, target->texture, nullptr, nullptr);
-            return;
-        }
-        target->finished = false;
-        std::vector<uint32_t> u8t = {stats.utf8_text[stats.type_counter]};
-        draw_utf8_text(u8t,
-                       font_atlas,
-                       renderer,
-                       stats.current_x,
-                       rect.y + (current_line * (size * v_offset / 100)),
-                       size,
-                       h_offset,
-                       target);
+    font_atlas.set_color_mod(previous);
+}
+#endif
 
-        stats.current_x += (size - (h_offset * size / 100));
-        stats.timer = 0;
-        stats.type_counter++;
-        if (stats.type_counter > tmptext.length() - 1 && callback != nullptr)
+void draw_frame_times(const FrameTimes &times,
+                      const FontAtlas &font_atlas,
+                      SDL_Renderer *renderer,
+                      const int x,
+                      const int y,
+                      const int size,
+                      SDL_Color color)
+{
+    char line[80];
+    snprintf(line, sizeof(line), "frame min %.2f avg %.2f p99 %.2f ms late %u",
+             times.min_ns / 1000000.0, times.average_ns() / 1000000.0, times.p99_ns() / 1000000.0,
+             times.frames_over(17000000));
+    const SDL_Color previous = font_atlas.set_color_mod(color);
+    draw_text(line, font_atlas, renderer, x, y, size);
+    font_atlas.set_color_mod(previous);
+}
+
+#if defined(__psp__) && defined(SIMPLE_TEXT_GU)
+/**
+ * Draw glyphs as GU_SPRITES, one display list chunk and one texture bind per page.
+ * glyphs(emit) must call emit(index, destiny) for every glyph, the same way every time.
+ */
+template <typename Glyphs>
+bool gu_draw_glyphs(const FontAtlas &font_atlas, SDL_Renderer *renderer, Glyphs glyphs, SDL_Color color)
+{
+    const int page_count = font_atlas.pages.empty() ? 1 : (int)font_atlas.pages.size();
+    const size_t mark = text_frame_arena.mark();
+    int *counts = text_frame_alloc<int>(page_count);
+    if (counts == nullptr)
+        return false;
+    for (int p = 0; p < page_count; p++)
+        counts[p] = 0;
+    glyphs([&](const int index, const SDL_Rect &)
+           { counts[font_atlas.glyph_page(index)]++; });
+
+    // Every page must have its copy before anything is drawn, so a failure can fall back to SDL.
+    for (int p = 0; p < page_count; p++)
+    {
+        if (counts[p] > 0 && font_atlas.gu_texture(p) == nullptr)
         {
-            callback();
+            text_frame_arena.release(mark);
+            return false;
         }
     }
-    else
-    {
-    if (SDL_GetRenderTarget(renderer) != nullptr)
+
+    // SDL's PSP renderer skips binding a texture or blend mode it thinks is current. An
+    // untextured blended point as its last command makes it bind both again after the sprites.
+    Uint8 r, g, b, a;
+    SDL_BlendMode mode;
+    SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
+    SDL_GetRenderDrawBlendMode(renderer, &mode);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_RenderDrawPoint(renderer, -1, -1);
+    SDL_SetRenderDrawColor(renderer, r, g, b, a);
+    SDL_SetRenderDrawBlendMode(renderer, mode);
+    SDL_RenderFlush(renderer);
+    const int status = sceGuGetAllStatus();
+    sceGuEnable(GU_TEXTURE_2D);
+    sceGuEnable(GU_BLEND);
+    sceGuBlendFunc(GU_ADD, GU_SRC_ALPHA, GU_ONE_MINUS_SRC_ALPHA, 0, 0);
+    sceGuTexFunc(GU_TFX_MODULATE, GU_TCC_RGBA);
+    sceGuTexFilter(GU_LINEAR, GU_LINEAR);
+    sceGuTexWrap(GU_CLAMP, GU_CLAMP);
+    if (font_atlas.pixel_format == ATLAS_PIXELS_SDF)
     {
-        SDL_SetRenderTarget(renderer, nullptr);
+        // The filtered field is cut at its edge, what passes is drawn opaque.
+        sceGuDisable(GU_BLEND);
+        sceGuEnable(GU_ALPHA_TEST);
+        sceGuAlphaFunc(GU_GREATER, 127, 0xFF);
     }
-    SDL_RenderCopy(renderer, target->texture, nullptr, nullptr);
+
+    const uint32_t abgr = (uint32_t)color.a << 24 | (uint32_t)color.b << 16 | (uint32_t)color.g << 8 | color.r;
+    for (int p = 0; p < page_count; p++)
+    {
+        if (counts[p] == 0)
+            continue;
+        font_atlas.gu_texture(p)->bind();
+        GuGlyphVertex *vertices = (GuGlyphVertex *)sceGuGetMemory(counts[p] * 2 * sizeof(GuGlyphVertex));
+        GuGlyphVertex *v = vertices;
+        glyphs([&](const int index, const SDL_Rect &destiny)
+               {
+                   if (font_atlas.glyph_page(index) != p)
+                       return;
+                   const SDL_Rect &src = font_atlas.glyph_rects[index];
+                   v[0] = {(uint16_t)src.x, (uint16_t)src.y, abgr, (int16_t)destiny.x, (int16_t)destiny.y, 0, 0};
+                   v[1] = {(uint16_t)(src.x + src.w), (uint16_t)(src.y + src.h), abgr,
+                           (int16_t)(destiny.x + destiny.w), (int16_t)(destiny.y + destiny.h), 0, 0};
+                   v += 2; });
+        SIMPLE_TEXT_COUNT(geometry_draws, 1);
+        SIMPLE_TEXT_COUNT(glyphs_drawn, counts[p]);
+        sceGuDrawArray(GU_SPRITES, GU_TEXTURE_16BIT | GU_COLOR_8888 | GU_VERTEX_16BIT | GU_TRANSFORM_2D,
+                       counts[p] * 2, nullptr, vertices);
     }
+    // Back to the state SDL left for that point, the texture, filter and wrap are bound by its next copy.
+    sceGuSetAllStatus(status);
+    sceGuBlendFunc(GU_ADD, GU_SRC_ALPHA, GU_ONE_MINUS_SRC_ALPHA, 0, 0);
+    sceGuTexFunc(GU_TFX_MODULATE, GU_TCC_RGBA);
+    sceGuAlphaFunc(GU_GREATER, 0, 0xFF);
+    text_frame_arena.release(mark);
+    return true;
 }
 
-void draw_text_multiline(const std::string &text,
+bool gu_draw_text(std::string_view text,
+                  const FontAtlas &font_atlas,
+                  SDL_Renderer *renderer,
+                  const int x,
+                  const int y,
+                  const int size,
+                  const int h_offset,
+                  SDL_Color color)
+{
+    color.a = 255;
+    return gu_draw_glyphs(font_atlas, renderer, [&](auto emit)
+                          {
+                              int current_x = x;
+                              int previous = -1;
+                              for (auto c : Utf8Text(text))
+                              {
+                                  const int index = c == ' ' ? -1 : font_atlas.glyph_index(c);
+                                  if (c != ' ' && index == -1)
+                                      continue;
+                                  current_x += font_atlas.kerning(previous, index, size);
+                                  if (index != -1)
+                                      emit(index, font_atlas.glyph_destiny(index, current_x, y, size));
+                                  current_x += font_atlas.glyph_advance(index, size, h_offset);
+                                  previous = index;
+                              } }, color);
+}
+
+bool gu_draw_text_layout(const TextLayout &layout,
                          const FontAtlas &font_atlas,
                          SDL_Renderer *renderer,
-                         const SDL_Rect &rect,
-                         const int size,
-                         const int h_offset,
-                         const int v_offset,
-                         CombinedTexture *target,
-                         std::vector<std::string> *c_lines)
+                         const int x,
+                         const int y,
+                         const size_t first,
+                         size_t count,
+                         SDL_Color color)
 {
-    if(target && target->finished)
-    {
-        SDL_Rect r;
-        r.x = rect.x;
-        r.y = rect.y;
-        r.h = rect.h;
-        r.w = rect.w;
-        SDL_RenderCopy(renderer, target->texture, &r, &r);
-        return;
-    }
-
-    std::vector<std::string> lines;
-    if (c_lines)
-        lines = *c_lines;
-    else
-        lines = split_text_by_size(text, size, h_offset, rect.w);
-    int current_y = rect.y;
-    for(auto l : lines)
-    {
-        if (target)
-        {
-            target->finished = false;
-            draw_text(l, font_atlas, renderer, rect.x, current_y, size, h_offset, target);
-        }
-        else
-        {
-            draw_text(l, font_atlas, renderer, rect.x, current_y, size, h_offset);
-        }
-        current_y += (size * v_offset / 100);
-    }
+    if (first >= layout.glyphs.size())
+        return true;
+    if (count > layout.glyphs.size() - first)
+        count = layout.glyphs.size() - first;
+    color.a = 255;
+    return gu_draw_glyphs(font_atlas, renderer, [&](auto emit)
+                          {
+                              for (size_t i = first; i < first + count; i++)
+                              {
+                                  const LayoutGlyph &g = layout.glyphs[i];
+                                  if (g.index != -1)
+                                      emit(g.index, font_atlas.glyph_destiny(g.index, x + g.x, y + g.y, layout.size));
+                              } }, color);
 }
+#endif
+
 #endif
\ No newline at end of file
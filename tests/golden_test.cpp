@@ -0,0 +1,240 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include "../simple_text.h"
+#include <unistd.h>
+
+/*
+Headless golden tests of the text pipeline. Every case is drawn twice with the
+raster_* functions, once glyph by glyph like draw_text and once through the
+batched path, and both must match pixel for pixel. The result is then compared
+with tests/golden/<case>.png. A missing golden image fails, --update writes them.
+The typewriter case is paced by draw_typewriter on a software renderer.
+Run from the folder that contains gfx/, or pass it as the first argument.
+*/
+
+const char atlas_characters[] = "!\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{¦}~⌂ÇçáéíóúãõüâêôñÑÁÉÍÓÚÃÕÜÂÊÔªº¿";
+
+const char sample_text[] = "Multiline test ÃÕêíó[] \"()\" 1234567890@#%&*~ The quick brown fox jumps over the lazy dog.";
+
+const SDL_Color background = {100, 50, 0, 255};
+
+bool update_golden = false;
+int failures = 0;
+
+/// Canvas sized like the PSP screen, filled with the sample background color.
+struct Screen
+{
+    SDL_Surface *surface;
+    TextCanvas canvas;
+
+    Screen() : surface(SDL_CreateRGBSurfaceWithFormat(0, 480, 272, 32, SDL_PIXELFORMAT_RGBA32)), canvas(surface)
+    {
+        canvas.clear(background);
+    }
+
+    ~Screen()
+    {
+        SDL_FreeSurface(surface);
+    }
+};
+
+/**
+ * Count the pixels that differ between two canvases of the same size.
+ */
+int count_differences(const TextCanvas &a, const TextCanvas &b)
+{
+    if (a.width != b.width || a.height != b.height)
+        return a.width * a.height;
+    int differences = 0;
+    for (int y = 0; y < a.height; y++)
+    {
+        const uint8_t *row_a = a.pixels + (size_t)y * a.pitch;
+        const uint8_t *row_b = b.pixels + (size_t)y * b.pitch;
+        for (int x = 0; x < a.width; x++)
+            differences += memcmp(row_a + x * 4, row_b + x * 4, 4) != 0;
+    }
+    return differences;
+}
+
+/**
+ * Compare the output of a case with its golden image, or write it with --update.
+ */
+void check_golden(const char *name, Screen &actual)
+{
+    Screen blank;
+    if (count_differences(blank.canvas, actual.canvas) == 0)
+    {
+        printf("FAIL %-16s nothing was drawn\n", name);
+        failures++;
+        return;
+    }
+
+    char path[128];
+    snprintf(path, sizeof(path), "tests/golden/%s.png", name);
+    if (update_golden)
+    {
+        if (IMG_SavePNG(actual.surface, path) != 0)
+        {
+            printf("FAIL %-16s could not write %s: %s\n", name, path, SDL_GetError());
+            failures++;
+            return;
+        }
+        printf("SAVE %-16s %s\n", name, path);
+        return;
+    }
+    SDL_Surface *loaded = IMG_Load(path);
+    if (loaded == nullptr)
+    {
+        printf("FAIL %-16s %s is missing, run make -C tests update after checking the output\n", name, path);
+        failures++;
+        return;
+    }
+    SDL_Surface *golden = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+    const int golden_differences = golden ? count_differences(TextCanvas(golden), actual.canvas) : -1;
+    SDL_FreeSurface(golden);
+    if (golden_differences != 0)
+    {
+        printf("FAIL %-16s %d pixels differ from %s\n", name, golden_differences, path);
+        failures++;
+        return;
+    }
+    printf("PASS %-16s\n", name);
+}
+
+/**
+ * Compare the expected and actual output of a case, then the actual output with its golden image.
+ */
+void check(const char *name, Screen &expected, Screen &actual)
+{
+    const int differences = count_differences(expected.canvas, actual.canvas);
+    if (differences != 0)
+    {
+        printf("FAIL %-16s %d pixels differ from the reference path\n", name, differences);
+        failures++;
+        return;
+    }
+    check_golden(name, actual);
+}
+
+/// A single line, glyph by glyph against draw_text_batched.
+void test_line(const FontAtlas &atlas)
+{
+    Screen expected;
+    raster_text(sample_text, atlas, expected.canvas, 8, 16, 16, 57, {255, 255, 0});
+
+    Screen actual;
+    TextBatch batch;
+    draw_text_batched(sample_text, atlas, batch, 8, 16, 16, 57, {255, 255, 0});
+    raster_batch(actual.canvas, batch, atlas);
+    check("line", expected, actual);
+}
+
+/// A wrapped text, glyph by glyph against the vertices built by build_quad_vertices.
+void test_multiline(const FontAtlas &atlas)
+{
+    TextLayout layout;
+    build_text_layout(layout, sample_text, atlas, 18, 57, 100, 480 - 32);
+
+    Screen expected;
+    raster_text_layout(layout, atlas, expected.canvas, 16, 40);
+
+    Screen actual;
+    TextBatch batch;
+    draw_text_layout_batched(layout, atlas, batch, 16, 40);
+    raster_batch(actual.canvas, batch, atlas);
+    check("multiline", expected, actual);
+}
+
+/**
+ * draw_typewriter run at 60 fps on a software renderer, with speed and pause markers.
+ * The glyphs it reveals every frame are drawn on top of each other, like its target
+ * texture. The frame halfway through is compared with its golden image, the end
+ * result with the whole text.
+ */
+void test_typewriter(const FontAtlas &atlas, const FontAtlas &screen_atlas, SDL_Renderer *renderer)
+{
+    std::string text = std::string("{s:2}") + sample_text;
+    text.insert(text.find(" The "), "{p:0.2}{s:0.5}");
+    const SDL_Rect rect = {16, 40, 480 - 32, 272 - 56};
+    TextLayout plain;
+    build_text_layout(plain, sample_text, atlas, 18, 57, 100, rect.w);
+
+    Screen expected;
+    raster_text_layout(plain, atlas, expected.canvas, rect.x, rect.y);
+
+    CombinedTexture target;
+    TypeStats stats(0, 16, 0.0f, 0.01f);
+    Screen halfway;
+    Screen actual;
+    for (int frame = 0; frame < 1000 && (frame == 0 || stats.type_counter < (int)stats.layout.glyphs.size()); frame++)
+    {
+        const int typed = stats.type_counter;
+        draw_typewriter(text, screen_atlas, renderer, rect, &target, stats, 18, nullptr, 57, 100);
+        raster_text_layout(stats.layout, atlas, actual.canvas, rect.x, rect.y, typed, stats.type_counter - typed);
+        if (frame == 45)
+            memcpy(halfway.surface->pixels, actual.surface->pixels, (size_t)actual.surface->pitch * actual.surface->h);
+        stats.timer += 1.0f / 60;
+    }
+    check_golden("typewriter_half", halfway);
+    check("typewriter", expected, actual);
+}
+
+/// Shadow and outline quads against drawing the text again at every offset.
+void test_effects(const FontAtlas &atlas)
+{
+    const SDL_Color black = {0, 0, 0, 255};
+    TextEffect effect = make_text_outline(1, black);
+    effect.shadow_x = 2;
+    effect.shadow_y = 2;
+    effect.shadow_color = black;
+
+    Screen expected;
+    raster_text(sample_text, atlas, expected.canvas, 10, 100, 16, 57, black);
+    const int offsets[8][2] = {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+    for (const auto &o : offsets)
+        raster_text(sample_text, atlas, expected.canvas, 8 + o[0], 98 + o[1], 16, 57, black);
+    raster_text(sample_text, atlas, expected.canvas, 8, 98, 16, 57);
+
+    Screen actual;
+    TextBatch batch;
+    draw_text_batched(sample_text, atlas, batch, 8, 98, 16, 57, {255, 255, 255}, &effect);
+    raster_batch(actual.canvas, batch, atlas);
+    check("effects", expected, actual);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *folder = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--update") == 0)
+            update_golden = true;
+        else
+            folder = argv[i];
+    }
+    if (folder)
+        chdir(folder);
+
+    // No renderer, the atlas keeps its image for the raster_* functions.
+    FontAtlas atlas("gfx/atlas.png", nullptr, atlas_characters);
+    if (atlas.headless_image == nullptr)
+    {
+        printf("Could not load gfx/atlas.png: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    // The typewriter keeps its own target texture, on a software renderer without a window.
+    Screen screen;
+    SDL_Renderer *renderer = SDL_CreateSoftwareRenderer(screen.surface);
+    {
+        FontAtlas screen_atlas("gfx/atlas.png", renderer, atlas_characters);
+        test_line(atlas);
+        test_multiline(atlas);
+        test_typewriter(atlas, screen_atlas, renderer);
+        test_effects(atlas);
+    }
+    printf("%d failed\n", failures);
+    SDL_DestroyRenderer(renderer);
+    return failures != 0;
+}
@@ -0,0 +1,271 @@
+/*
+Packs a font atlas png, its characters and optional metrics into the binary font
+file loaded by FontAtlas(filename, renderer), so the game skips the png decode
+and the character parsing at startup.
+
+Usage: font_pack <atlas.png> <characters.txt> <output.stf> [options]
+    --cell <w> <h>      size of a glyph cell, 32 32 by default
+    --metrics <file>    proportional metrics sidecar, see FontAtlas::load_metrics
+    --format <name>     rgba (default), t8 or t4. t8 and t4 only keep the alpha
+                        coverage, glyphs are drawn white and tinted by the color
+    --swizzle           store the pixels swizzled for the PSP GE
+    --sdf <spread>      store a signed distance field of the coverage, spread
+                        pixels on each side of the edges, as t8. Loaded as
+                        ATLAS_PIXELS_SDF, it stays sharp when scaled
+
+The texture is padded to power of two sizes, as required by the PSP GE.
+*/
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include "../simple_text.h"
+
+/// Round up to the next power of two, at least minimum.
+int next_pow2(const int value, const int minimum)
+{
+    int size = minimum;
+    while (size < value)
+        size *= 2;
+    return size;
+}
+
+/// Round up to a multiple of 16, the alignment of every table in the file.
+uint32_t align16(const size_t value)
+{
+    return (uint32_t)((value + 15) & ~(size_t)15);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        printf("Usage: font_pack <atlas.png> <characters.txt> <output.stf> [--cell w h] [--metrics file] [--format rgba|t8|t4] [--swizzle] [--sdf spread]\n");
+        return 1;
+    }
+    const char *atlas_file = argv[1];
+    const char *characters_file = argv[2];
+    const char *output_file = argv[3];
+    int cell_w = 32;
+    int cell_h = 32;
+    const char *metrics_file = nullptr;
+    int format = FONT_PIXELS_RGBA8888;
+    bool swizzle = false;
+    int sdf_spread = 0;
+    for (int i = 4; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--cell") == 0 && i + 2 < argc)
+        {
+            cell_w = atoi(argv[++i]);
+            cell_h = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+        {
+            metrics_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "t8") == 0)
+                format = FONT_PIXELS_T8;
+            else if (strcmp(argv[i], "t4") == 0)
+                format = FONT_PIXELS_T4;
+            else if (strcmp(argv[i], "rgba") != 0)
+            {
+                printf("Unknown format %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--swizzle") == 0)
+        {
+            swizzle = true;
+        }
+        else if (strcmp(argv[i], "--sdf") == 0 && i + 1 < argc)
+        {
+            sdf_spread = atoi(argv[++i]);
+            if (sdf_spread < 1)
+            {
+                printf("The sdf spread must be at least 1\n");
+                return 1;
+            }
+        }
+        else
+        {
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    size_t characters_length = 0;
+    char *characters = (char *)SDL_LoadFile(characters_file, &characters_length);
+    if (characters == nullptr)
+    {
+        printf("Could not read %s: %s\n", characters_file, SDL_GetError());
+        return 1;
+    }
+    while (characters_length > 0 && (characters[characters_length - 1] == '\n' || characters[characters_length - 1] == '\r'))
+        characters[--characters_length] = '\0';
+
+    SDL_Surface *image = IMG_Load(atlas_file);
+    SDL_Surface *source = image ? SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA32, 0) : nullptr;
+    SDL_FreeSurface(image);
+    if (source == nullptr)
+    {
+        printf("Could not load %s: %s\n", atlas_file, SDL_GetError());
+        return 1;
+    }
+
+    // FontAtlas builds the glyph tables exactly like the game does, on a software renderer.
+    SDL_Surface *canvas = SDL_CreateRGBSurfaceWithFormat(0, 1, 1, 32, SDL_PIXELFORMAT_RGBA32);
+    SDL_Renderer *renderer = SDL_CreateSoftwareRenderer(canvas);
+    FontAtlas atlas(atlas_file, renderer, characters, cell_w, cell_h);
+    SDL_free(characters);
+    if (metrics_file && !atlas.load_metrics(metrics_file))
+    {
+        printf("Could not read %s\n", metrics_file);
+        return 1;
+    }
+
+    // The field replaces the coverage, computed before the texture is padded.
+    if (sdf_spread > 0)
+    {
+        format = FONT_PIXELS_T8;
+        std::vector<uint8_t> alpha((size_t)source->w * source->h);
+        std::vector<uint8_t> field(alpha.size());
+        SDL_LockSurface(source);
+        for (int y = 0; y < source->h; y++)
+        {
+            const uint8_t *row = (const uint8_t *)source->pixels + (size_t)y * source->pitch;
+            for (int x = 0; x < source->w; x++)
+                alpha[(size_t)y * source->w + x] = row[x * 4 + 3];
+        }
+        build_distance_field(alpha.data(), field.data(), source->w, source->h, atlas.cell_width, atlas.cell_height, sdf_spread);
+        for (int y = 0; y < source->h; y++)
+        {
+            uint8_t *row = (uint8_t *)source->pixels + (size_t)y * source->pitch;
+            for (int x = 0; x < source->w; x++)
+                row[x * 4 + 3] = field[(size_t)y * source->w + x];
+        }
+        SDL_UnlockSurface(source);
+    }
+
+    // Swizzled rows are 16 byte blocks, so narrow palettized textures get wider.
+    const int min_width = format == FONT_PIXELS_T4 ? 32 : (format == FONT_PIXELS_T8 ? 16 : 4);
+    const int width = next_pow2(source->w, min_width);
+    const int height = next_pow2(source->h, 8);
+    int row_bytes = width * 4;
+    int palette_size = 0;
+    if (format == FONT_PIXELS_T8)
+    {
+        row_bytes = width;
+        palette_size = 256;
+    }
+    else if (format == FONT_PIXELS_T4)
+    {
+        row_bytes = width / 2;
+        palette_size = 16;
+    }
+
+    std::vector<uint8_t> pixels((size_t)row_bytes * height, 0);
+    SDL_LockSurface(source);
+    for (int y = 0; y < source->h; y++)
+    {
+        const uint8_t *row = (const uint8_t *)source->pixels + (size_t)y * source->pitch;
+        uint8_t *out = pixels.data() + (size_t)y * row_bytes;
+        for (int x = 0; x < source->w; x++)
+        {
+            const uint8_t *pixel = row + x * 4;
+            if (format == FONT_PIXELS_RGBA8888)
+                memcpy(out + x * 4, pixel, 4);
+            else if (format == FONT_PIXELS_T8)
+                out[x] = pixel[3];
+            else
+                out[x / 2] |= (uint8_t)(((pixel[3] * 15 + 127) / 255) << ((x & 1) * 4));
+        }
+    }
+    SDL_UnlockSurface(source);
+    SDL_FreeSurface(source);
+
+    if (swizzle)
+    {
+        std::vector<uint8_t> linear = pixels;
+        swizzle_pixels(linear.data(), pixels.data(), row_bytes, height, true);
+    }
+
+    std::vector<uint8_t> palette(palette_size * 4);
+    for (int i = 0; i < palette_size; i++)
+    {
+        palette[i * 4 + 0] = 255;
+        palette[i * 4 + 1] = 255;
+        palette[i * 4 + 2] = 255;
+        palette[i * 4 + 3] = (uint8_t)(i * 255 / (palette_size - 1));
+    }
+
+    std::vector<uint32_t> codepoints;
+    for (auto c : Utf8Text(atlas.characters))
+        codepoints.push_back(c);
+    const bool metrics = !atlas.glyph_metrics.empty();
+    std::vector<FontFileGlyph> glyphs(atlas.glyph_count);
+    for (int i = 0; i < atlas.glyph_count; i++)
+    {
+        const SDL_Rect &r = atlas.glyph_rects[i];
+        FontFileGlyph &g = glyphs[i];
+        g.x = (int16_t)r.x;
+        g.y = (int16_t)r.y;
+        g.w = (int16_t)r.w;
+        g.h = (int16_t)r.h;
+        g.bearing_x = metrics ? (int16_t)atlas.glyph_metrics[i].bearing_x : 0;
+        g.bearing_y = metrics ? (int16_t)atlas.glyph_metrics[i].bearing_y : 0;
+        g.advance = metrics ? (int16_t)atlas.glyph_metrics[i].advance : (int16_t)r.w;
+        g.reserved = 0;
+    }
+    std::vector<FontFileKerning> kerning;
+    for (const auto &k : atlas.kerning_pairs)
+        kerning.push_back({k.pair, k.amount});
+
+    FontFileHeader header = {};
+    header.magic = FONT_FILE_MAGIC;
+    header.version = FONT_FILE_VERSION;
+    header.flags = (swizzle ? FONT_FILE_SWIZZLED : 0) | (metrics ? FONT_FILE_METRICS : 0) | (sdf_spread > 0 ? FONT_FILE_SDF : 0);
+    header.glyph_count = (uint16_t)atlas.glyph_count;
+    header.pixel_format = (uint16_t)format;
+    header.texture_width = (uint16_t)width;
+    header.texture_height = (uint16_t)height;
+    header.cell_width = (uint16_t)atlas.cell_width;
+    header.cell_height = (uint16_t)atlas.cell_height;
+    header.space_advance = atlas.space_advance;
+    header.kerning_count = (uint32_t)kerning.size();
+    header.codepoints_offset = align16(sizeof(header));
+    header.glyphs_offset = align16(header.codepoints_offset + codepoints.size() * 4);
+    header.kerning_offset = align16(header.glyphs_offset + glyphs.size() * sizeof(FontFileGlyph));
+    header.palette_offset = align16(header.kerning_offset + kerning.size() * sizeof(FontFileKerning));
+    header.pixels_offset = align16(header.palette_offset + palette.size());
+    header.pixels_size = (uint32_t)pixels.size();
+
+    std::vector<uint8_t> file(header.pixels_offset + pixels.size(), 0);
+    auto write = [&](const uint32_t offset, const void *data, const size_t size)
+    {
+        if (size > 0)
+            memcpy(file.data() + offset, data, size);
+    };
+    write(0, &header, sizeof(header));
+    write(header.codepoints_offset, codepoints.data(), codepoints.size() * 4);
+    write(header.glyphs_offset, glyphs.data(), glyphs.size() * sizeof(FontFileGlyph));
+    write(header.kerning_offset, kerning.data(), kerning.size() * sizeof(FontFileKerning));
+    write(header.palette_offset, palette.data(), palette.size());
+    write(header.pixels_offset, pixels.data(), pixels.size());
+
+    FILE *out = fopen(output_file, "wb");
+    if (out == nullptr || fwrite(file.data(), 1, file.size(), out) != file.size())
+    {
+        printf("Could not write %s\n", output_file);
+        return 1;
+    }
+    fclose(out);
+    printf("%s: %d glyphs, %zu kerning pairs, %dx%d %s%s%s, %zu bytes\n",
+           output_file, atlas.glyph_count, kerning.size(), width, height,
+           format == FONT_PIXELS_T8 ? "t8" : (format == FONT_PIXELS_T4 ? "t4" : "rgba"),
+           swizzle ? " swizzled" : "", sdf_spread > 0 ? " sdf" : "", file.size());
+
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(canvas);
+    return 0;
+}